@@ -16,6 +16,15 @@ The audiodescription Gstreamer plugin provides the elements
    waveform
  - adcontrol - processes metadata produced by whp198dec to 'fade' another audio
    track (so as to make the description audio be heard clearly)
+ - adpesparse - extracts audio-description metadata from the PES headers of
+   an MPEG transport stream
+ - adpesinject - attaches audio-description metadata to compressed audio
+   frames, for carriage in PES headers
+ - adshmsink - publishes audio-description metadata in shared memory, for
+   adcontrol elements in other processes
+
+The WHP 198 decoder is also provided as the standalone library libwhp198,
+which has no dependency on Gstreamer.
 
 %prep
 %setup
@@ -30,9 +39,14 @@ rm -rf $RPM_BUILD_ROOT
 make DESTDIR=$RPM_BUILD_ROOT install
 rm $RPM_BUILD_ROOT/usr/lib64/gstreamer-1.0/*.la
 rm $RPM_BUILD_ROOT/usr/lib64/gstreamer-1.0/*.a
+rm $RPM_BUILD_ROOT/usr/lib64/*.la
+rm $RPM_BUILD_ROOT/usr/lib64/*.a
 
 %clean
 rm -rf $RPM_BUILD_ROOT
 
 %files
 %{_libdir}/gstreamer-1.0/*.so
+%{_libdir}/libwhp198.so*
+%{_includedir}/whp198.h
+%{_libdir}/pkgconfig/whp198.pc
@@ -23,6 +23,66 @@
  * consuming "AD_descriptor" metadata as defined in
  * "ETSI Technical Report 101 154".
  *
+ * The AD_fade_byte of each descriptor sets the gain of every channel of the
+ * main audio.  Descriptors which also carry AD_gain_byte_center,
+ * AD_gain_byte_front and AD_gain_byte_surround additionally adjust the gain
+ * of the channels in those positions (according to the channel positions
+ * of the negotiated main audio caps).
+ *
+ * If the "fallback" property is set, the description audio may also be
+ * given to the description_sink pad.  Should no descriptor arrive for
+ * "fallback-timeout", the main audio is then ducked by "fallback-depth"
+ * whenever the description audio is louder than "fallback-threshold",
+ * until descriptors resume.
+ *
+ * Further descriptor tracks (for example, description in other languages)
+ * may be given to ad_sink_%u request pads.  Every track's fade timeline is
+ * maintained as its descriptors arrive, but only the track selected by the
+ * "active-track" property (ad_sink being track 0) fades the main audio.
+ * The "switch-track" action signal changes the active track at a given
+ * running time, which may fall part way through a buffer of main audio.
+ * Releasing the pad of the active track (or of one about to be switched
+ * to) switches back to track 0 in its place, rather than leaving the main
+ * audio unfaded.
+ *
+ * The gain applied to the main audio may also be taken from a gain_src
+ * request pad, as F32 audio of one channel per main audio channel at
+ * "gain-rate" samples per second, timestamped in running time.  Mixers in
+ * other processes can then apply the fade themselves.  The gain is pushed
+ * from the main audio's streaming thread, so anything downstream of
+ * gain_src which blocks (a network sink with a slow client, say) holds up
+ * the main audio too; a queue after gain_src (leaky, where losing some of
+ * the gain signal is better than stalling) decouples the two.
+ *
+ * While PLAYING, each buffer of main audio is held until descriptors of
+ * the active track covering it have arrived, but no later than the
+ * pipeline clock reaches the buffer's running time plus the configured
+ * latency (which includes the latency of the descriptors), or 100ms until
+ * that is configured.  A track whose descriptors stop is not waited for
+ * again until they resume.  Buffers passing while PAUSED (when prerolling,
+ * say) are not held.
+ *
+ * Setting the "delay" property holds the main audio back by that much, so
+ * that descriptors timestamped with their first bit (see whp198dec's
+ * "first-bit-timestamps" property) arrive before the audio they apply to,
+ * and fades start on time.  The delay is included in the reported latency.
+ * It may only be changed in the READY state or below, and applies from the
+ * next change to PAUSED.
+ * "ramp-shape" selects how the gain moves between successive descriptors.
+ *
+ * Instead of arriving on ad_sink, descriptors for track 0 may be taken
+ * from the shared memory named by "shm-name", as published by an
+ * adshmsink element in another process.  The segment is polled by a thread
+ * of its own while the element is PLAYING, so descriptors keep arriving
+ * even while the main audio is stalled.  Descriptors are stamped with
+ * absolute clock time, which is turned back into running time using this
+ * element's base time, so both pipelines must use clocks with the same
+ * time base: the system clock (which is monotonic, so only comparable on
+ * one machine), or network clocks slaved to one master.  An audio sink's
+ * clock, say, would not do.  On opening the segment, reading starts from
+ * the newest descriptor published for a time already reached, so that the
+ * fade in effect is taken up at once.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -39,11 +99,13 @@
 #include "config.h"
 #endif
 
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <gst/gst.h>
 #include <gst/audio/audio.h>
 #include <gst/audio/streamvolume.h>
 #include <gst/controller/gstinterpolationcontrolsource.h>
-#include <gst/controller/gstdirectcontrolbinding.h>
 #include "gstadcontrol.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_adcontrol_debug_category);
@@ -58,14 +120,120 @@ static void gst_adcontrol_get_property (GObject * object,
     guint property_id, GValue * value, GParamSpec * pspec);
 static void gst_adcontrol_dispose (GObject * object);
 static void gst_adcontrol_finalize (GObject * object);
+static GstStateChangeReturn gst_adcontrol_change_state (GstElement * element,
+    GstStateChange transition);
 static GstFlowReturn
 gst_adcontrol_chain (GstPad * pad, GstObject * parent, GstBuffer *buf);
+static gboolean
+gst_adcontrol_ad_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static GstFlowReturn
+gst_adcontrol_main_chain (GstPad * pad, GstObject * parent, GstBuffer *buf);
+static gboolean
+gst_adcontrol_main_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static gboolean
+gst_adcontrol_main_query (GstPad * pad, GstObject * parent, GstQuery * query);
+static gboolean
+gst_adcontrol_main_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static GstIterator *
+gst_adcontrol_iterate_internal_links (GstPad * pad, GstObject * parent);
+static GstFlowReturn
+gst_adcontrol_description_chain (GstPad * pad, GstObject * parent, GstBuffer *buf);
+static gboolean
+gst_adcontrol_description_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static GstPad *gst_adcontrol_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_adcontrol_release_pad (GstElement * element, GstPad * pad);
+static void gst_adcontrol_switch_track (GstAdcontrol * self, guint track,
+    guint64 running_time);
+static void gst_adcontrol_start_shm (GstAdcontrol * self);
+static void gst_adcontrol_stop_shm (GstAdcontrol * self);
+static gboolean
+gst_adcontrol_gain_query (GstPad * pad, GstObject * parent, GstQuery * query);
+
+enum
+{
+  SIGNAL_SWITCH_TRACK,
+  LAST_SIGNAL
+};
+
+static guint gst_adcontrol_signals[LAST_SIGNAL] = { 0 };
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_ACTIVE_TRACK,
+  PROP_GAIN_RATE,
+  PROP_DELAY,
+  PROP_RAMP_SHAPE,
+  PROP_SHM_NAME,
+  PROP_FALLBACK,
+  PROP_FALLBACK_TIMEOUT,
+  PROP_FALLBACK_ATTACK,
+  PROP_FALLBACK_RELEASE,
+  PROP_FALLBACK_DEPTH,
+  PROP_FALLBACK_THRESHOLD
 };
 
+#define DEFAULT_ACTIVE_TRACK 0
+#define DEFAULT_GAIN_RATE 100
+#define DEFAULT_DELAY 0
+#define DEFAULT_RAMP_SHAPE GST_ADCONTROL_RAMP_LINEAR
+#define MAX_DELAY GST_SECOND
+// the time taken for a typical 8-byte descriptor to arrive at the WHP 198
+// data rate, which bounds the wait for descriptors until the pipeline
+// configures its latency,
+#define DEFAULT_DESCRIPTOR_WAIT (100 * GST_MSECOND)
+#define DEFAULT_SHM_NAME NULL
+// how often to read new descriptors from shared memory, and to try
+// opening shared memory which does not yet exist (in microseconds),
+#define SHM_POLL_INTERVAL (10 * G_TIME_SPAN_MILLISECOND)
+#define SHM_RETRY_INTERVAL G_TIME_SPAN_SECOND
+#define DEFAULT_FALLBACK FALSE
+#define DEFAULT_FALLBACK_TIMEOUT (2 * GST_SECOND)
+#define DEFAULT_FALLBACK_ATTACK (20 * GST_MSECOND)
+#define DEFAULT_FALLBACK_RELEASE (500 * GST_MSECOND)
+#define DEFAULT_FALLBACK_DEPTH -12.0
+#define DEFAULT_FALLBACK_THRESHOLD -45.0
+
+#define GST_TYPE_ADCONTROL_RAMP_SHAPE (gst_adcontrol_ramp_shape_get_type ())
+static GType
+gst_adcontrol_ramp_shape_get_type (void)
+{
+  static GType ramp_shape_type = 0;
+  static const GEnumValue ramp_shapes[] = {
+    {GST_ADCONTROL_RAMP_LINEAR, "Linear", "linear"},
+    {GST_ADCONTROL_RAMP_S_CURVE, "S-curve (monotonic cubic)", "s-curve"},
+    {GST_ADCONTROL_RAMP_STEP, "Step (no ramp)", "step"},
+    {0, NULL, NULL},
+  };
+
+  if (!ramp_shape_type) {
+    ramp_shape_type = g_enum_register_static ("GstAdcontrolRampShape", ramp_shapes);
+  }
+  return ramp_shape_type;
+}
+
+static GstInterpolationMode
+interpolation_mode_for_shape (GstAdcontrolRampShape shape)
+{
+  switch (shape) {
+    case GST_ADCONTROL_RAMP_S_CURVE:
+#if GST_CHECK_VERSION(1,8,0)
+      return GST_INTERPOLATION_MODE_CUBIC_MONOTONIC;
+#else
+      // plain cubic interpolation would overshoot, which is worse than no
+      // curve at all,
+      return GST_INTERPOLATION_MODE_LINEAR;
+#endif
+    case GST_ADCONTROL_RAMP_STEP:
+      return GST_INTERPOLATION_MODE_NONE;
+    case GST_ADCONTROL_RAMP_LINEAR:
+    default:
+      return GST_INTERPOLATION_MODE_LINEAR;
+  }
+}
+
 /* pad templates */
 
 #define FORMAT "{ "GST_AUDIO_NE(F32)","GST_AUDIO_NE(S16)" }"
@@ -86,6 +254,14 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("main_src",
         "layout = (string) { interleaved, non-interleaved }, "
         "rate = (int) [ 1, MAX ], " "channels = (int) [ 1, MAX ]"));
 
+static GstStaticPadTemplate description_sink_template = GST_STATIC_PAD_TEMPLATE ("description_sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " FORMAT ", "
+        "layout = (string) interleaved, "
+        "rate = (int) [ 1, MAX ], " "channels = (int) [ 1, MAX ]"));
+
 static GstStaticPadTemplate gst_adcontrol_sink_template =
 GST_STATIC_PAD_TEMPLATE ("ad_sink",
     GST_PAD_SINK,
@@ -93,10 +269,25 @@ GST_STATIC_PAD_TEMPLATE ("ad_sink",
     GST_STATIC_CAPS ("application/x-tr_101_154_ad_descriptor")
     );
 
+static GstStaticPadTemplate gain_src_template = GST_STATIC_PAD_TEMPLATE ("gain_src",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE(F32) ", "
+        "layout = (string) interleaved, "
+        "rate = (int) [ 1, MAX ], " "channels = (int) [ 1, MAX ]"));
+
+static GstStaticPadTemplate gst_adcontrol_request_sink_template =
+GST_STATIC_PAD_TEMPLATE ("ad_sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("application/x-tr_101_154_ad_descriptor")
+    );
+
 
 /* class initialization */
 
-G_DEFINE_TYPE_WITH_CODE (GstAdcontrol, gst_adcontrol, GST_TYPE_BIN,
+G_DEFINE_TYPE_WITH_CODE (GstAdcontrol, gst_adcontrol, GST_TYPE_ELEMENT,
   GST_DEBUG_CATEGORY_INIT (gst_adcontrol_debug_category, "adcontrol", 0,
   "debug category for adcontrol element"));
 
@@ -104,15 +295,20 @@ static void
 gst_adcontrol_class_init (GstAdcontrolClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
-  GstBinClass *bin_class = GST_BIN_CLASS (klass);
 
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS(klass),
       gst_static_pad_template_get (&src_template));
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS(klass),
       gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS(klass),
+      gst_static_pad_template_get (&gain_src_template));
 
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS(klass),
       gst_static_pad_template_get (&gst_adcontrol_sink_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS(klass),
+      gst_static_pad_template_get (&gst_adcontrol_request_sink_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS(klass),
+      gst_static_pad_template_get (&description_sink_template));
 
   gst_element_class_set_static_metadata (GST_ELEMENT_CLASS(klass),
       "Audio Description Controler", "Generic", "Accepts Audio Description descriptors defining the 'pan' of the description track, and the 'fade' of the main track, and adjusts the audio levels of the given controls to suit",
@@ -122,43 +318,336 @@ gst_adcontrol_class_init (GstAdcontrolClass * klass)
   gobject_class->get_property = gst_adcontrol_get_property;
   gobject_class->dispose = gst_adcontrol_dispose;
   gobject_class->finalize = gst_adcontrol_finalize;
+  GST_ELEMENT_CLASS (klass)->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_adcontrol_request_new_pad);
+  GST_ELEMENT_CLASS (klass)->release_pad =
+      GST_DEBUG_FUNCPTR (gst_adcontrol_release_pad);
+  GST_ELEMENT_CLASS (klass)->change_state =
+      GST_DEBUG_FUNCPTR (gst_adcontrol_change_state);
+  klass->switch_track = gst_adcontrol_switch_track;
+
+  g_object_class_install_property (gobject_class, PROP_ACTIVE_TRACK,
+      g_param_spec_uint ("active-track", "Active track",
+          "Descriptor track applied to the main audio (0 for ad_sink, or the number of an ad_sink_%u pad)",
+          0, G_MAXUINT, DEFAULT_ACTIVE_TRACK,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_GAIN_RATE,
+      g_param_spec_uint ("gain-rate", "Gain rate",
+          "Sample rate of the gain signal output on the gain_src pad",
+          1, 48000, DEFAULT_GAIN_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DELAY,
+      g_param_spec_uint64 ("delay", "Delay",
+          "Lookahead delay of the main audio, allowing descriptors to arrive before the audio they apply to (in nanoseconds)",
+          0, MAX_DELAY, DEFAULT_DELAY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_RAMP_SHAPE,
+      g_param_spec_enum ("ramp-shape", "Ramp shape",
+          "Shape of the change in gain between successive descriptors",
+          GST_TYPE_ADCONTROL_RAMP_SHAPE, DEFAULT_RAMP_SHAPE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SHM_NAME,
+      g_param_spec_string ("shm-name", "Shared memory name",
+          "Name of shared memory (written by adshmsink) from which to read descriptors for track 0, or NULL",
+          DEFAULT_SHM_NAME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FALLBACK,
+      g_param_spec_boolean ("fallback", "Fallback",
+          "Duck the main audio according to the level of the description audio while no descriptors are arriving",
+          DEFAULT_FALLBACK, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FALLBACK_TIMEOUT,
+      g_param_spec_uint64 ("fallback-timeout", "Fallback timeout",
+          "Time since the last descriptor after which fallback ducking starts (in nanoseconds)",
+          0, G_MAXUINT64, DEFAULT_FALLBACK_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FALLBACK_ATTACK,
+      g_param_spec_uint64 ("fallback-attack", "Fallback attack",
+          "Time constant of fallback ducking as the description starts (in nanoseconds)",
+          0, G_MAXUINT64, DEFAULT_FALLBACK_ATTACK,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FALLBACK_RELEASE,
+      g_param_spec_uint64 ("fallback-release", "Fallback release",
+          "Time constant of fallback ducking as the description stops (in nanoseconds)",
+          0, G_MAXUINT64, DEFAULT_FALLBACK_RELEASE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FALLBACK_DEPTH,
+      g_param_spec_double ("fallback-depth", "Fallback depth",
+          "Gain applied to the main audio by fallback ducking (in dB)",
+          -76.5, 0.0, DEFAULT_FALLBACK_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FALLBACK_THRESHOLD,
+      g_param_spec_double ("fallback-threshold", "Fallback threshold",
+          "Level of the description audio above which fallback ducking is applied (in dBFS)",
+          -120.0, 0.0, DEFAULT_FALLBACK_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstAdcontrol::switch-track:
+   * @adcontrol: the adcontrol
+   * @track: the track to make active
+   * @running_time: running time of the main audio at which to switch
+   *
+   * Make @track the active track from @running_time onward.  A switch
+   * not yet reached is replaced by any later request.
+   */
+  gst_adcontrol_signals[SIGNAL_SWITCH_TRACK] =
+      g_signal_new ("switch-track", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstAdcontrolClass, switch_track), NULL, NULL, NULL,
+      G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT64);
+}
+
+static GstAdcontrolTrack *
+gst_adcontrol_track_new (GstPad *pad, guint index, GstAdcontrolRampShape shape)
+{
+  GstAdcontrolTrack *track = g_new0 (GstAdcontrolTrack, 1);
+  track->index = index;
+  track->pad = pad;
+  gst_segment_init (&track->segment, GST_FORMAT_TIME);
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    track->fade_control[s] = gst_interpolation_control_source_new();
+    g_object_set (track->fade_control[s], "mode", interpolation_mode_for_shape (shape), NULL);
+  }
+  track->last_descriptor_time = GST_CLOCK_TIME_NONE;
+  track->position = GST_CLOCK_TIME_NONE;
+  track->eos = FALSE;
+  track->starved = FALSE;
 
+  gst_pad_set_element_private (pad, track);
+  gst_pad_use_fixed_caps (pad);
+  gst_pad_set_chain_function (pad, gst_adcontrol_chain);
+  gst_pad_set_event_function (pad, gst_adcontrol_ad_event);
+  gst_pad_set_iterate_internal_links_function (pad,
+      gst_adcontrol_iterate_internal_links);
+  return track;
 }
 
 static void
-gst_adcontrol_init (GstAdcontrol *self)
+gst_adcontrol_track_free (GstAdcontrolTrack *track)
+{
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    if (track->fade_control[s]) {
+      g_object_unref (track->fade_control[s]);
+    }
+  }
+  g_free (track);
+}
+
+/* called with the object lock held */
+static GstAdcontrolTrack *
+gst_adcontrol_find_track (GstAdcontrol *self, guint index)
+{
+  for (GList *l = self->tracks; l != NULL; l = l->next) {
+    GstAdcontrolTrack *track = l->data;
+    if (track->index == index) {
+      return track;
+    }
+  }
+  return NULL;
+}
+
+/* The track which fades main audio at running time 'ts'.  Called with the
+ * object lock held. */
+static guint
+gst_adcontrol_track_at (GstAdcontrol *self, GstClockTime ts)
+{
+  if (GST_CLOCK_TIME_IS_VALID (self->pending_time) && ts >= self->pending_time) {
+    return self->pending_track;
+  }
+  return self->active_track;
+}
+
+static void
+gst_adcontrol_switch_track (GstAdcontrol *self, guint track,
+    guint64 running_time)
+{
+  GST_INFO_OBJECT (self, "switching to track %u at %" GST_TIME_FORMAT,
+      track, GST_TIME_ARGS (running_time));
+  GST_OBJECT_LOCK (self);
+  self->pending_track = track;
+  self->pending_time = running_time;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static GstPad *
+gst_adcontrol_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstAdcontrol *self = GST_ADCONTROL (element);
+  guint index;
+
+  if (templ == gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (element), "gain_src")) {
+    GST_OBJECT_LOCK (self);
+    if (self->gain_src) {
+      GST_OBJECT_UNLOCK (self);
+      GST_WARNING_OBJECT (self, "gain_src already exists");
+      return NULL;
+    }
+    GstPad *pad = gst_pad_new_from_template (templ, "gain_src");
+    gst_pad_use_fixed_caps (pad);
+    gst_pad_set_query_function (pad, gst_adcontrol_gain_query);
+    gst_pad_set_iterate_internal_links_function (pad,
+        gst_adcontrol_iterate_internal_links);
+    self->gain_src = pad;
+    self->gain_reset = TRUE;
+    GST_OBJECT_UNLOCK (self);
+
+    gst_pad_set_active (pad, TRUE);
+    gst_element_add_pad (element, pad);
+    return pad;
+  }
+
+  GST_OBJECT_LOCK (self);
+  if (name == NULL || sscanf (name, "ad_sink_%u", &index) != 1) {
+    index = self->next_track;
+  }
+  if (gst_adcontrol_find_track (self, index)) {
+    GST_OBJECT_UNLOCK (self);
+    GST_WARNING_OBJECT (self, "track %u already exists", index);
+    return NULL;
+  }
+  self->next_track = MAX (self->next_track, index + 1);
+  gchar *pad_name = g_strdup_printf ("ad_sink_%u", index);
+  GstPad *pad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  self->tracks = g_list_append (self->tracks, gst_adcontrol_track_new (pad, index, self->ramp_shape));
+  GST_OBJECT_UNLOCK (self);
+
+  gst_pad_set_active (pad, TRUE);
+  gst_element_add_pad (element, pad);
+  return pad;
+}
+
+static void
+gst_adcontrol_release_pad (GstElement * element, GstPad * pad)
 {
-  self->volume_element = gst_element_factory_make ("volume", "ad-main-volume");
-  if (!self->volume_element) {
-    GST_WARNING_OBJECT (self, "failed to create volume element");
+  GstAdcontrol *self = GST_ADCONTROL (element);
+
+  if (pad == self->gain_src) {
+    GST_OBJECT_LOCK (self);
+    self->gain_src = NULL;
+    GST_OBJECT_UNLOCK (self);
+    gst_element_remove_pad (element, pad);
     return;
   }
 
-  self->fade_control = gst_interpolation_control_source_new();
-  g_object_set (self->fade_control, "mode", GST_INTERPOLATION_MODE_LINEAR, NULL);
-  GstControlBinding *binding
-    = gst_direct_control_binding_new (GST_OBJECT(self->volume_element),
-                                      "volume",
-                                      self->fade_control);
-  gst_object_add_control_binding (GST_OBJECT(self->volume_element), binding);
+  GstAdcontrolTrack *track = gst_pad_get_element_private (pad);
+
+  GST_OBJECT_LOCK (self);
+  self->tracks = g_list_remove (self->tracks, track);
+  // ad_sink is always there to take over from the released track,
+  if (self->active_track == track->index) {
+    GST_WARNING_OBJECT (self, "active track %u released; switching to track %u",
+        track->index, DEFAULT_ACTIVE_TRACK);
+    self->active_track = DEFAULT_ACTIVE_TRACK;
+  }
+  if (GST_CLOCK_TIME_IS_VALID (self->pending_time)
+      && self->pending_track == track->index) {
+    GST_WARNING_OBJECT (self, "track %u released before switching to it; "
+        "switching to track %u instead", track->index, DEFAULT_ACTIVE_TRACK);
+    self->pending_track = DEFAULT_ACTIVE_TRACK;
+  }
+  // main audio may be waiting on this track,
+  g_cond_broadcast (&self->descriptor_cond);
+  GST_OBJECT_UNLOCK (self);
+
+  // removing the pad deactivates it, so its streaming thread is done with
+  // the track once this returns,
+  gst_element_remove_pad (element, pad);
+  gst_adcontrol_track_free (track);
+}
+
+static void
+gst_adcontrol_init (GstAdcontrol *self)
+{
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    self->speaker_gains[s] = NULL;
+  }
+  self->gains = NULL;
+  self->scratch_frames = 0;
+  self->passthrough = FALSE;
+  self->speakers = NULL;
+  self->speaker_groups = 0;
+  gst_audio_info_init (&self->info);
+  gst_segment_init (&self->main_segment, GST_FORMAT_TIME);
+  self->main_position = GST_CLOCK_TIME_NONE;
+  g_cond_init (&self->descriptor_cond);
+  g_mutex_init (&self->control_lock);
+  self->descriptor_wait = DEFAULT_DESCRIPTOR_WAIT;
+  self->main_flushing = FALSE;
+
+  self->tracks = NULL;
+  self->next_track = 1;
+  self->active_track = DEFAULT_ACTIVE_TRACK;
+  self->pending_track = DEFAULT_ACTIVE_TRACK;
+  self->pending_time = GST_CLOCK_TIME_NONE;
+  self->ramp_shape = DEFAULT_RAMP_SHAPE;
+
+  self->shm_name = g_strdup (DEFAULT_SHM_NAME);
+  self->shm_changed = FALSE;
+  self->shm_thread = NULL;
+  g_cond_init (&self->shm_cond);
+  self->shm_stop = FALSE;
+  self->shm = NULL;
+  self->shm_index = 0;
+  self->shm_retry_time = 0;
+
+  self->delay = DEFAULT_DELAY;
+  self->delay_frames = 0;
+  self->delay_ring = NULL;
+  self->delay_ring_size = 0;
+  self->delay_ring_pos = 0;
+  self->delay_filled = 0;
+  self->delay_end_pts = GST_CLOCK_TIME_NONE;
+
+  self->gain_src = NULL;
+  self->gain_rate = DEFAULT_GAIN_RATE;
+  self->gain_reset = FALSE;
+  self->gain_need_segment = TRUE;
+  self->gain_negotiated_rate = 0;
+  self->gain_next = GST_BUFFER_OFFSET_NONE;
+  self->gain_pool = NULL;
+  self->gain_pool_size = 0;
+  self->gain_unity = NULL;
+
+  self->fallback = DEFAULT_FALLBACK;
+  self->fallback_timeout = DEFAULT_FALLBACK_TIMEOUT;
+  self->fallback_attack = DEFAULT_FALLBACK_ATTACK;
+  self->fallback_release = DEFAULT_FALLBACK_RELEASE;
+  self->fallback_depth = DEFAULT_FALLBACK_DEPTH;
+  self->fallback_threshold = DEFAULT_FALLBACK_THRESHOLD;
+  gst_audio_info_init (&self->description_info);
+  gst_segment_init (&self->description_segment, GST_FORMAT_TIME);
+  self->description_start = GST_CLOCK_TIME_NONE;
+  self->fallback_active = FALSE;
+  self->fallback_gain = 0.0;
+  self->fallback_point_gain = 0.0;
 
-  GST_BIN_GET_CLASS (self)->add_element (GST_BIN_CAST (self),
-      self->volume_element);
+  self->main_sink = gst_pad_new_from_static_template (&sink_template, "main_sink");
+  gst_pad_set_chain_function (self->main_sink, gst_adcontrol_main_chain);
+  gst_pad_set_event_function (self->main_sink, gst_adcontrol_main_event);
+  gst_pad_set_query_function (self->main_sink, gst_adcontrol_main_query);
+  gst_pad_set_iterate_internal_links_function (self->main_sink,
+      gst_adcontrol_iterate_internal_links);
+  gst_element_add_pad (GST_ELEMENT_CAST (self), self->main_sink);
 
-  GstPad *volume_sink = gst_element_get_static_pad (self->volume_element, "sink");
-  GstPad *ghost_sink = gst_ghost_pad_new_from_template ("main_sink", volume_sink, GST_PAD_PAD_TEMPLATE (volume_sink));
-  gst_object_unref (volume_sink);
-  gst_element_add_pad (GST_ELEMENT_CAST (self), ghost_sink);  
+  self->main_src = gst_pad_new_from_static_template (&src_template, "main_src");
+  gst_pad_set_event_function (self->main_src, gst_adcontrol_main_src_event);
+  gst_pad_set_query_function (self->main_src, gst_adcontrol_main_query);
+  gst_pad_set_iterate_internal_links_function (self->main_src,
+      gst_adcontrol_iterate_internal_links);
+  gst_element_add_pad (GST_ELEMENT_CAST (self), self->main_src);
 
-  GstPad *volume_src = gst_element_get_static_pad (self->volume_element, "src");
-  GstPad *ghost_src = gst_ghost_pad_new_from_template ("main_src", volume_src, GST_PAD_PAD_TEMPLATE (volume_src));
-  gst_object_unref (volume_src);
-  gst_element_add_pad (GST_ELEMENT_CAST (self), ghost_src);  
+  GstPad *ad_sink = gst_pad_new_from_static_template(&gst_adcontrol_sink_template, "ad_sink");
+  self->tracks = g_list_append (self->tracks,
+      gst_adcontrol_track_new (ad_sink, 0, self->ramp_shape));
+  gst_element_add_pad (GST_ELEMENT (self), ad_sink);
 
-  self->ad_sink = gst_pad_new_from_static_template(&gst_adcontrol_sink_template, "ad_sink");
-  gst_pad_use_fixed_caps (self->ad_sink);
-  gst_element_add_pad (GST_ELEMENT (self), self->ad_sink);
-  gst_pad_set_chain_function (self->ad_sink, gst_adcontrol_chain);
+  self->description_sink = gst_pad_new_from_static_template (&description_sink_template, "description_sink");
+  gst_pad_set_chain_function (self->description_sink, gst_adcontrol_description_chain);
+  gst_pad_set_event_function (self->description_sink, gst_adcontrol_description_event);
+  gst_pad_set_iterate_internal_links_function (self->description_sink,
+      gst_adcontrol_iterate_internal_links);
+  gst_element_add_pad (GST_ELEMENT (self), self->description_sink);
 }
 
 void
@@ -169,11 +658,59 @@ gst_adcontrol_set_property (GObject * object, guint property_id,
 
   GST_DEBUG_OBJECT (adcontrol, "set_property");
 
+  GST_OBJECT_LOCK (adcontrol);
   switch (property_id) {
+    case PROP_ACTIVE_TRACK:
+      // effective from the start of the next buffer of main audio,
+      adcontrol->pending_track = g_value_get_uint (value);
+      adcontrol->pending_time = 0;
+      break;
+    case PROP_GAIN_RATE:
+      adcontrol->gain_rate = g_value_get_uint (value);
+      break;
+    case PROP_DELAY:
+      // takes effect on the next change from READY to PAUSED,
+      adcontrol->delay = g_value_get_uint64 (value);
+      break;
+    case PROP_SHM_NAME:
+      g_free (adcontrol->shm_name);
+      adcontrol->shm_name = g_value_dup_string (value);
+      adcontrol->shm_changed = TRUE;
+      g_cond_signal (&adcontrol->shm_cond);
+      break;
+    case PROP_RAMP_SHAPE:
+      adcontrol->ramp_shape = g_value_get_enum (value);
+      for (GList *l = adcontrol->tracks; l != NULL; l = l->next) {
+        GstAdcontrolTrack *track = l->data;
+        for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+          g_object_set (track->fade_control[s], "mode",
+              interpolation_mode_for_shape (adcontrol->ramp_shape), NULL);
+        }
+      }
+      break;
+    case PROP_FALLBACK:
+      adcontrol->fallback = g_value_get_boolean (value);
+      break;
+    case PROP_FALLBACK_TIMEOUT:
+      adcontrol->fallback_timeout = g_value_get_uint64 (value);
+      break;
+    case PROP_FALLBACK_ATTACK:
+      adcontrol->fallback_attack = g_value_get_uint64 (value);
+      break;
+    case PROP_FALLBACK_RELEASE:
+      adcontrol->fallback_release = g_value_get_uint64 (value);
+      break;
+    case PROP_FALLBACK_DEPTH:
+      adcontrol->fallback_depth = g_value_get_double (value);
+      break;
+    case PROP_FALLBACK_THRESHOLD:
+      adcontrol->fallback_threshold = g_value_get_double (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
   }
+  GST_OBJECT_UNLOCK (adcontrol);
 }
 
 void
@@ -184,11 +721,47 @@ gst_adcontrol_get_property (GObject * object, guint property_id,
 
   GST_DEBUG_OBJECT (adcontrol, "get_property");
 
+  GST_OBJECT_LOCK (adcontrol);
   switch (property_id) {
+    case PROP_ACTIVE_TRACK:
+      g_value_set_uint (value, GST_CLOCK_TIME_IS_VALID (adcontrol->pending_time)
+          ? adcontrol->pending_track : adcontrol->active_track);
+      break;
+    case PROP_GAIN_RATE:
+      g_value_set_uint (value, adcontrol->gain_rate);
+      break;
+    case PROP_DELAY:
+      g_value_set_uint64 (value, adcontrol->delay);
+      break;
+    case PROP_RAMP_SHAPE:
+      g_value_set_enum (value, adcontrol->ramp_shape);
+      break;
+    case PROP_SHM_NAME:
+      g_value_set_string (value, adcontrol->shm_name);
+      break;
+    case PROP_FALLBACK:
+      g_value_set_boolean (value, adcontrol->fallback);
+      break;
+    case PROP_FALLBACK_TIMEOUT:
+      g_value_set_uint64 (value, adcontrol->fallback_timeout);
+      break;
+    case PROP_FALLBACK_ATTACK:
+      g_value_set_uint64 (value, adcontrol->fallback_attack);
+      break;
+    case PROP_FALLBACK_RELEASE:
+      g_value_set_uint64 (value, adcontrol->fallback_release);
+      break;
+    case PROP_FALLBACK_DEPTH:
+      g_value_set_double (value, adcontrol->fallback_depth);
+      break;
+    case PROP_FALLBACK_THRESHOLD:
+      g_value_set_double (value, adcontrol->fallback_threshold);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
   }
+  GST_OBJECT_UNLOCK (adcontrol);
 }
 
 void
@@ -200,14 +773,31 @@ gst_adcontrol_dispose (GObject * object)
 
   /* clean up as possible.  may be called multiple times */
 
-  if (adcontrol->fade_control) {
-    g_object_unref(adcontrol->fade_control);
-    adcontrol->fade_control = NULL;
+  for (GList *l = adcontrol->tracks; l != NULL; l = l->next) {
+    GstAdcontrolTrack *track = l->data;
+    for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+      if (track->fade_control[s]) {
+        g_object_unref(track->fade_control[s]);
+        track->fade_control[s] = NULL;
+      }
+    }
   }
 
   G_OBJECT_CLASS (gst_adcontrol_parent_class)->dispose (object);
 }
 
+static void
+gst_adcontrol_free_gain_pool (GstAdcontrol *self)
+{
+  if (self->gain_pool) {
+    gst_buffer_pool_set_active (self->gain_pool, FALSE);
+    gst_object_unref (self->gain_pool);
+    self->gain_pool = NULL;
+    self->gain_pool_size = 0;
+  }
+  gst_buffer_replace (&self->gain_unity, NULL);
+}
+
 void
 gst_adcontrol_finalize (GObject * object)
 {
@@ -216,10 +806,94 @@ gst_adcontrol_finalize (GObject * object)
   GST_DEBUG_OBJECT (adcontrol, "finalize");
 
   /* clean up object here */
+  g_list_free_full (adcontrol->tracks, (GDestroyNotify) gst_adcontrol_track_free);
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    g_free (adcontrol->speaker_gains[s]);
+  }
+  g_free (adcontrol->gains);
+  g_free (adcontrol->speakers);
+  g_free (adcontrol->delay_ring);
+  g_cond_clear (&adcontrol->descriptor_cond);
+  g_mutex_clear (&adcontrol->control_lock);
+  gst_adcontrol_stop_shm (adcontrol);
+  g_free (adcontrol->shm_name);
+  g_cond_clear (&adcontrol->shm_cond);
+  gst_adcontrol_free_gain_pool (adcontrol);
 
   G_OBJECT_CLASS (gst_adcontrol_parent_class)->finalize (object);
 }
 
+/* Size the delay ring for the current delay and format (any audio held is
+ * dropped), so that delaying main audio never allocates. */
+static void
+gst_adcontrol_setup_delay (GstAdcontrol *self)
+{
+  GST_OBJECT_LOCK (self);
+  const GstClockTime delay = self->delay;
+  GST_OBJECT_UNLOCK (self);
+
+  const gint rate = GST_AUDIO_INFO_RATE (&self->info);
+  self->delay_frames = rate > 0
+      ? gst_util_uint64_scale_round (delay, rate, GST_SECOND) : 0;
+  self->delay_ring_size = (gsize) self->delay_frames * GST_AUDIO_INFO_BPF (&self->info);
+  g_free (self->delay_ring);
+  self->delay_ring = self->delay_ring_size ? g_malloc (self->delay_ring_size) : NULL;
+  self->delay_ring_pos = 0;
+  self->delay_filled = 0;
+  self->delay_end_pts = GST_CLOCK_TIME_NONE;
+}
+
+static GstStateChangeReturn
+gst_adcontrol_change_state (GstElement * element, GstStateChange transition)
+{
+  GstAdcontrol *self = GST_ADCONTROL (element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      GST_OBJECT_LOCK (self);
+      self->main_flushing = FALSE;
+      GST_OBJECT_UNLOCK (self);
+      // a delay set while in READY applies from here on (and is sized
+      // again for the format once caps arrive),
+      gst_adcontrol_setup_delay (self);
+      gst_adcontrol_start_shm (self);
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      // release main audio waiting for descriptors against a clock which
+      // is about to stop,
+      GST_OBJECT_LOCK (self);
+      g_cond_broadcast (&self->descriptor_cond);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      // release main audio waiting for descriptors, so that the pads can
+      // be deactivated,
+      GST_OBJECT_LOCK (self);
+      self->main_flushing = TRUE;
+      g_cond_broadcast (&self->descriptor_cond);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      break;
+  }
+
+  GstStateChangeReturn ret =
+      GST_ELEMENT_CLASS (gst_adcontrol_parent_class)->change_state (element,
+      transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      // the streaming threads have stopped, so nothing is using the pool,
+      gst_adcontrol_free_gain_pool (self);
+      gst_adcontrol_stop_shm (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
 static gdouble
 fade_byte_to_volume(const guint8 fade_byte)
 {
@@ -227,6 +901,14 @@ fade_byte_to_volume(const guint8 fade_byte)
   return -fade_byte * db_per_step;
 }
 
+/* AD_gain_byte_* values are signed, in steps of 0.5dB */
+static gdouble
+gain_byte_to_volume(const guint8 gain_byte)
+{
+  const gdouble db_per_step = 0.5;
+  return (gint8) gain_byte * db_per_step;
+}
+
 /* assumes stereo pan, clamping values which only make sense for surround into the stereo range */
 static gdouble
 pan_byte_to_pan(guint8 pan_byte)
@@ -245,59 +927,1628 @@ pan_byte_to_pan(guint8 pan_byte)
   return pan / MAX;
 }
 
+static guint8
+speakers_for_position (GstAudioChannelPosition position)
+{
+  switch (position) {
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_CENTER:
+      return GST_ADCONTROL_SPEAKERS_CENTRE;
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER:
+    case GST_AUDIO_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER:
+    case GST_AUDIO_CHANNEL_POSITION_WIDE_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_WIDE_RIGHT:
+      return GST_ADCONTROL_SPEAKERS_FRONT;
+    case GST_AUDIO_CHANNEL_POSITION_REAR_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_REAR_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_REAR_CENTER:
+    case GST_AUDIO_CHANNEL_POSITION_SIDE_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_SIDE_RIGHT:
+    case GST_AUDIO_CHANNEL_POSITION_SURROUND_LEFT:
+    case GST_AUDIO_CHANNEL_POSITION_SURROUND_RIGHT:
+      return GST_ADCONTROL_SPEAKERS_SURROUND;
+    default:
+      return GST_ADCONTROL_SPEAKERS_OTHER;
+  }
+}
+
+static gboolean
+gst_adcontrol_set_caps (GstAdcontrol *self, GstCaps *caps)
+{
+  GstAudioInfo info;
+
+  if (!gst_audio_info_from_caps (&info, caps)) {
+    GST_WARNING_OBJECT (self, "invalid caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  self->info = info;
+
+  gint channels = GST_AUDIO_INFO_CHANNELS (&info);
+  g_free (self->speakers);
+  self->speakers = g_new (guint8, channels);
+  self->speaker_groups = 0;
+  for (gint c = 0; c < channels; c++) {
+    if (c < 64 && !GST_AUDIO_INFO_IS_UNPOSITIONED (&info)) {
+      self->speakers[c] = speakers_for_position (info.position[c]);
+    } else {
+      self->speakers[c] = GST_ADCONTROL_SPEAKERS_OTHER;
+    }
+    self->speaker_groups |= 1 << self->speakers[c];
+  }
+  // force the scratch space to be resized for the new channel count, and
+  // the gain output to follow the new channels,
+  self->scratch_frames = 0;
+  self->gain_negotiated_rate = 0;
+
+  // any audio held for the old format is dropped,
+  gst_adcontrol_setup_delay (self);
+  return TRUE;
+}
+
+static void
+remove_old_control_points (GstTimedValueControlSource *ctl, GstClockTime position)
+{
+  GList *list = gst_timed_value_control_source_get_all(ctl);
+  // the last point before 'position' is kept, since it's still needed to
+  // interpolate the gain at 'position',
+  for (GList * l = list; l != NULL && l->next != NULL; l = l->next) {
+    GstTimedValue *timed = (GstTimedValue *)l->data;
+    GstTimedValue *next = (GstTimedValue *)l->next->data;
+    if (next->timestamp > position) {
+      break;
+    }
+    if (!gst_timed_value_control_source_unset (ctl, timed->timestamp)) {
+      GST_DEBUG ("gst_timed_value_control_source_unset(fade_ctl, ...) failed");
+    }
+  }
+  g_list_free(list);
+}
+
+static void
+remove_later_control_points (GstTimedValueControlSource *ctl, GstClockTime ts)
+{
+  GList *list = gst_timed_value_control_source_get_all(ctl);
+  for (GList * l = list; l != NULL; l = l->next) {
+    GstTimedValue *timed = (GstTimedValue *)l->data;
+    if (timed->timestamp > ts) {
+      gst_timed_value_control_source_unset (ctl, timed->timestamp);
+    }
+  }
+  g_list_free(list);
+}
+
+/* Add a control point at running time 'ts' to the timeline of each group
+ * of speakers of a track, with the given gains (in dB).  The points are
+ * changed as one under 'control_lock', so that descriptors and fallback
+ * ducking never interleave their changes. */
+static void
+gst_adcontrol_set_gains (GstAdcontrol *self, GstControlSource **fade_control,
+    GstClockTime ts, const gdouble *speaker_db, gboolean replace_later)
+{
+  GST_OBJECT_LOCK (self);
+  GstClockTime position = self->main_position;
+  GST_OBJECT_UNLOCK (self);
+  if (!GST_CLOCK_TIME_IS_VALID (position)) {
+    // main audio is not flowing yet, so just bound the number of points
+    // held,
+    position = ts > GST_SECOND ? ts - GST_SECOND : 0;
+  }
+
+  g_mutex_lock (&self->control_lock);
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    GstTimedValueControlSource *fade_ctl
+      = GST_TIMED_VALUE_CONTROL_SOURCE(fade_control[s]);
+
+    if (replace_later) {
+      remove_later_control_points (fade_ctl, ts);
+    }
+    gdouble linear
+      = gst_stream_volume_convert_volume(GST_STREAM_VOLUME_FORMAT_DB,
+                                         GST_STREAM_VOLUME_FORMAT_LINEAR,
+                                         speaker_db[s]);
+    if (!gst_timed_value_control_source_set (fade_ctl, ts, linear)) {
+      GST_DEBUG_OBJECT (self, "gst_timed_value_control_source_set(fade_ctl, ...) failed");
+    }
+
+    // Remove control points which main audio has already passed,
+    remove_old_control_points (fade_ctl, position);
+  }
+  g_mutex_unlock (&self->control_lock);
+}
+
+/* Apply a descriptor (at least 9 bytes of it) to the fade timeline of the
+ * given track, from running time 'ts' */
+static void
+gst_adcontrol_handle_descriptor (GstAdcontrol *self, GstAdcontrolTrack *track,
+    GstClockTime ts, const guint8 *data, gsize size)
+{
+  // TODO: extract descriptor-parsing code, validate headers, etc.
+  const gint descriptor_length = data[0] & 0x0f;
+  const guint8 revision_text_tag = data[6];
+  const guint8 fade_byte = data[7];
+  const guint8 pan_byte = data[8];
+  gdouble speaker_db[GST_ADCONTROL_SPEAKERS_COUNT] = { 0.0, 0.0, 0.0, 0.0 };
+  // AD_gain_byte_center, AD_gain_byte_front and AD_gain_byte_surround are
+  // present from revision '2' of the descriptor,
+  if (revision_text_tag >= 0x32 && descriptor_length >= 11 && size >= 12) {
+    speaker_db[GST_ADCONTROL_SPEAKERS_CENTRE] = gain_byte_to_volume (data[9]);
+    speaker_db[GST_ADCONTROL_SPEAKERS_FRONT] = gain_byte_to_volume (data[10]);
+    speaker_db[GST_ADCONTROL_SPEAKERS_SURROUND] = gain_byte_to_volume (data[11]);
+  }
+
+  // fallback ducking only ever applies to the active track,
+  GST_OBJECT_LOCK (self);
+  gboolean active = gst_adcontrol_track_at (self, ts) == track->index;
+  gboolean was_fallback = active && self->fallback_active;
+  if (active) {
+    self->fallback_active = FALSE;
+  }
+  track->last_descriptor_time = ts;
+  if (!GST_CLOCK_TIME_IS_VALID (track->position) || ts > track->position) {
+    track->position = ts;
+  }
+  track->starved = FALSE;
+  g_cond_broadcast (&self->descriptor_cond);
+  GST_OBJECT_UNLOCK (self);
+  if (was_fallback) {
+    GST_INFO_OBJECT (self, "descriptors resumed; leaving fallback ducking");
+  }
+
+  gdouble gains_db[GST_ADCONTROL_SPEAKERS_COUNT];
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    gains_db[s] = fade_byte_to_volume(fade_byte) + speaker_db[s];
+  }
+  // any points which fallback ducking had placed beyond this descriptor
+  // are superseded by it,
+  gst_adcontrol_set_gains (self, track->fade_control, ts, gains_db, was_fallback);
+
+  GST_DEBUG_OBJECT (self,
+                    "track %u set volume %f (centre %+.1f, front %+.1f, surround %+.1f) ts=%" GST_TIME_FORMAT " (%d vol ctrl points queued)",
+                    track->index,
+                    fade_byte_to_volume(fade_byte),
+                    speaker_db[GST_ADCONTROL_SPEAKERS_CENTRE],
+                    speaker_db[GST_ADCONTROL_SPEAKERS_FRONT],
+                    speaker_db[GST_ADCONTROL_SPEAKERS_SURROUND],
+                    GST_TIME_ARGS(ts),
+                    gst_timed_value_control_source_get_count (
+                      GST_TIMED_VALUE_CONTROL_SOURCE(track->fade_control[0])));
+}
+
 static GstFlowReturn
 gst_adcontrol_chain (GstPad * pad, GstObject * parent, GstBuffer *buf)
 {
   GstAdcontrol *self = GST_ADCONTROL (parent);
+  GstAdcontrolTrack *track = gst_pad_get_element_private (pad);
 
-  GstClockTime ts = GST_BUFFER_PTS(buf);
+  GstClockTime ts = gst_segment_to_running_time (&track->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
   GstMapInfo map;
   if (gst_buffer_get_size(buf) < 9) {
     GST_DEBUG_OBJECT (self, "audio descriptor too short");
+    gst_buffer_unref (buf);
     return GST_FLOW_ERROR;
   }
+  if (!GST_CLOCK_TIME_IS_VALID (ts)) {
+    GST_DEBUG_OBJECT (self, "audio descriptor outside segment");
+    gst_buffer_unref (buf);
+    return GST_FLOW_OK;
+  }
   if (!gst_buffer_map (buf, &map, GST_MAP_READ)) {
+    gst_buffer_unref (buf);
     return GST_FLOW_ERROR;
   }
-  // TODO: extract descriptor-parsing code, validate headers, etc.
-  const guint8 fade_byte = map.data[7];
-  const guint8 pan_byte = map.data[8];
+  gst_adcontrol_handle_descriptor (self, track, ts, map.data, map.size);
   gst_buffer_unmap(buf, &map);
+  gst_buffer_unref (buf);
 
-  GstTimedValueControlSource *fade_ctl
-    = GST_TIMED_VALUE_CONTROL_SOURCE(self->fade_control);
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_adcontrol_ad_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+  GstAdcontrolTrack *track = gst_pad_get_element_private (pad);
 
-  gdouble linear
-    = gst_stream_volume_convert_volume(GST_STREAM_VOLUME_FORMAT_DB,
-                                       GST_STREAM_VOLUME_FORMAT_LINEAR,
-                                       fade_byte_to_volume(fade_byte));
-  // TODO: why do we need this division by 10?
-  if (!gst_timed_value_control_source_set (fade_ctl, ts, linear / 10.0)) {
-    GST_DEBUG_OBJECT (self, "gst_timed_value_control_source_set(fade_ctl, ...) failed");
+  // descriptors are consumed here, so none of their events go any further
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &track->segment);
+      break;
+    case GST_EVENT_STREAM_START:
+      GST_OBJECT_LOCK (self);
+      track->eos = FALSE;
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case GST_EVENT_EOS:
+      // main audio is not to wait for descriptors which will never come,
+      GST_OBJECT_LOCK (self);
+      track->eos = TRUE;
+      g_cond_broadcast (&self->descriptor_cond);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&track->segment, GST_FORMAT_TIME);
+      GST_OBJECT_LOCK (self);
+      track->position = GST_CLOCK_TIME_NONE;
+      track->eos = FALSE;
+      track->starved = FALSE;
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      break;
   }
+  gst_event_unref (event);
+  return TRUE;
+}
 
-  // Remove old control points.
-  // FIXME: bit of a bodge removing points older than one second; better
-  // would be something like removing points older than the last buffer
-  // timestamp emitted by the volume element, or something like that.
-  GstClockTime old = ts - GST_SECOND;
-  GList *list = gst_timed_value_control_source_get_all(fade_ctl);
-  for (GList * l = list; l != NULL; l = l->next) {
-    GstTimedValue *timed = (GstTimedValue *)l->data;
-    if (timed->timestamp < old) {
-      if (!gst_timed_value_control_source_unset (fade_ctl, timed->timestamp)) {
-        GST_DEBUG_OBJECT (self, "gst_timed_value_control_source_unset(pan_ctl, ...) failed");
+/* Evaluate 'n' frames of the fade timeline of the given track (if any),
+ * from running time 'ts', into the speaker gains from frame 'offset'.  Only
+ * the speaker groups present in the main audio are evaluated. */
+static void
+evaluate_track (GstAdcontrol *self, GstControlSource **fade_control,
+    GstClockTime ts, GstClockTime interval, guint offset, guint n)
+{
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    if (!(self->speaker_groups & (1 << s))) {
+      continue;
+    }
+    gdouble *values = self->speaker_gains[s] + offset;
+    if (fade_control == NULL
+        || !gst_control_source_get_value_array (fade_control[s], ts,
+            interval, n, values)) {
+      for (guint f = 0; f < n; f++) {
+        values[f] = 1.0;
+      }
+    } else {
+      // no gain is defined before the first descriptor arrives,
+      for (guint f = 0; f < n; f++) {
+        if (isnan (values[f])) {
+          values[f] = 1.0;
+        }
       }
     }
   }
-  g_list_free(list);
+}
 
-  GST_DEBUG_OBJECT (self,
-                    "set volume %f, linear=%f ts=%" GST_TIME_FORMAT " (%d vol ctrl points queued)",
-                    fade_byte_to_volume(fade_byte),
-                    linear,
-                    GST_TIME_ARGS(ts),
-                    gst_timed_value_control_source_get_count (fade_ctl));
+/* Take a reference to the fade timelines of the given track, so that they
+ * may be used without the object lock held, returning FALSE if there is no
+ * such track.  Called with the object lock held. */
+static gboolean
+ref_track_controls (GstAdcontrol *self, guint index,
+    GstControlSource **fade_control)
+{
+  GstAdcontrolTrack *track = gst_adcontrol_find_track (self, index);
+  if (track == NULL) {
+    return FALSE;
+  }
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    fade_control[s] = g_object_ref (track->fade_control[s]);
+  }
+  return TRUE;
+}
 
-  return GST_FLOW_OK;
+static void
+unref_track_controls (GstControlSource **fade_control)
+{
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    g_object_unref (fade_control[s]);
+  }
+}
+
+/* Deviation from a gain of 1.0 still treated as unity, allowing for
+ * interpolation between points of 0dB not landing exactly on 1.0; a change
+ * of level far too small to hear, and well below the 0.3dB fade step. */
+#define UNITY_TOLERANCE 1e-6
+
+static gboolean
+value_is_unity (GstControlSource *control, GstClockTime ts)
+{
+  gdouble value;
+  // no gain is defined before the first point,
+  if (!gst_control_source_get_value (control, ts, &value) || isnan (value)) {
+    return TRUE;
+  }
+  return fabs (value - 1.0) <= UNITY_TOLERANCE;
+}
+
+/* Whether a fade timeline holds unity gain throughout [ts, end), judged
+ * from the gain at either end and at the points in between so as to be
+ * cheap enough to check for every buffer.  Every ramp shape is monotonic
+ * between points, so the gain can't stray from unity anywhere else. */
+static gboolean
+control_is_unity (GstControlSource *control, GstClockTime ts, GstClockTime end)
+{
+  if (!value_is_unity (control, ts) || !value_is_unity (control, end)) {
+    return FALSE;
+  }
+  // points which main audio has passed are removed, so the list is short,
+  gboolean unity = TRUE;
+  GList *list = gst_timed_value_control_source_get_all (
+      GST_TIMED_VALUE_CONTROL_SOURCE (control));
+  for (GList *l = list; l != NULL; l = l->next) {
+    GstTimedValue *timed = (GstTimedValue *) l->data;
+    if (timed->timestamp >= end) {
+      break;
+    }
+    if (timed->timestamp > ts && fabs (timed->value - 1.0) > UNITY_TOLERANCE) {
+      unity = FALSE;
+      break;
+    }
+  }
+  g_list_free (list);
+  return unity;
+}
+
+/* Whether the fade timelines of a track hold unity gain throughout
+ * [ts, end), checked under 'control_lock' so as not to see a change to
+ * them half made. */
+static gboolean
+track_is_unity (GstAdcontrol *self, GstControlSource **fade_control,
+    GstClockTime ts, GstClockTime end)
+{
+  gboolean unity = TRUE;
+  g_mutex_lock (&self->control_lock);
+  for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+    if ((self->speaker_groups & (1 << s))
+        && !control_is_unity (fade_control[s], ts, end)) {
+      unity = FALSE;
+      break;
+    }
+  }
+  g_mutex_unlock (&self->control_lock);
+  return unity;
+}
+
+/* Evaluate the fade timeline of the active track for every frame of a
+ * buffer starting at running time 'ts', producing the gain for every
+ * interleaved sample.  A pending switch of track falling within the buffer
+ * takes effect from the frame at which it is due.  Returns FALSE, without
+ * evaluating anything, if the gain is unity throughout the buffer. */
+static gboolean
+compute_gains (GstAdcontrol *self, GstClockTime ts, guint frames)
+{
+  const gint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+  const gint rate = GST_AUDIO_INFO_RATE (&self->info);
+  const GstClockTime interval = GST_SECOND / rate;
+
+  if (frames > self->scratch_frames) {
+    for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+      self->speaker_gains[s] = g_renew (gdouble, self->speaker_gains[s], frames);
+    }
+    self->gains = g_renew (gfloat, self->gains, frames * channels);
+    self->scratch_frames = frames;
+  }
+
+  GstControlSource *before[GST_ADCONTROL_SPEAKERS_COUNT];
+  GstControlSource *after[GST_ADCONTROL_SPEAKERS_COUNT];
+  gboolean have_before, have_after = FALSE;
+  guint split = frames;
+
+  GST_OBJECT_LOCK (self);
+  have_before = ref_track_controls (self, self->active_track, before);
+  if (GST_CLOCK_TIME_IS_VALID (self->pending_time)) {
+    if (self->pending_time <= ts) {
+      split = 0;
+    } else {
+      split = MIN (frames, (self->pending_time - ts + interval - 1) / interval);
+    }
+    if (split < frames) {
+      GST_DEBUG_OBJECT (self, "switching from track %u to %u at frame %u",
+          self->active_track, self->pending_track, split);
+      have_after = ref_track_controls (self, self->pending_track, after);
+      self->active_track = self->pending_track;
+      self->pending_time = GST_CLOCK_TIME_NONE;
+    }
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  // a missing track leaves the main audio untouched,
+  const GstClockTime split_ts = ts + split * interval;
+  const gboolean unity =
+      (split == 0 || !have_before
+          || track_is_unity (self, before, ts, split_ts))
+      && (split == frames || !have_after
+          || track_is_unity (self, after, split_ts,
+              ts + frames * interval));
+
+  if (!unity) {
+    if (split > 0) {
+      evaluate_track (self, have_before ? before : NULL, ts, interval, 0, split);
+    }
+    if (split < frames) {
+      evaluate_track (self, have_after ? after : NULL, split_ts,
+          interval, split, frames - split);
+    }
+  }
+  if (have_before) {
+    unref_track_controls (before);
+  }
+  if (have_after) {
+    unref_track_controls (after);
+  }
+  if (unity) {
+    return FALSE;
+  }
+
+  gfloat *gains = self->gains;
+  if (GST_AUDIO_INFO_LAYOUT (&self->info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED) {
+    for (gint c = 0; c < channels; c++) {
+      const gdouble *speaker_gains = self->speaker_gains[self->speakers[c]];
+      for (guint f = 0; f < frames; f++) {
+        *gains++ = speaker_gains[f];
+      }
+    }
+  } else {
+    for (guint f = 0; f < frames; f++) {
+      for (gint c = 0; c < channels; c++) {
+        *gains++ = self->speaker_gains[self->speakers[c]][f];
+      }
+    }
+  }
+  return TRUE;
+}
+
+/* The gain of channel 'c' at frame 'f' of the gains computed for a buffer
+ * of 'frames' frames. */
+static inline gfloat
+gain_at (GstAdcontrol *self, const gfloat *gains, guint f, gint c, guint frames)
+{
+  if (GST_AUDIO_INFO_LAYOUT (&self->info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED) {
+    return gains[c * frames + f];
+  }
+  return gains[f * GST_AUDIO_INFO_CHANNELS (&self->info) + c];
+}
+
+/* 'restrict' promises the compiler that the samples and gains don't
+ * overlap, so that (given the -ftree-vectorize which configure adds) these
+ * loops are vectorised */
+static void
+apply_gains_f32 (gfloat *restrict data, const gfloat *restrict gains,
+    guint samples)
+{
+  for (guint i = 0; i < samples; i++) {
+    data[i] *= gains[i];
+  }
+}
+
+static void
+apply_gains_s16 (gint16 *restrict data, const gfloat *restrict gains,
+    guint samples)
+{
+  for (guint i = 0; i < samples; i++) {
+    gint val = (gint) (data[i] * gains[i]);
+    data[i] = CLAMP (val, G_MININT16, G_MAXINT16);
+  }
+}
+
+static void
+apply_gains (GstAudioFormat format, gpointer data, const gfloat *gains,
+    guint samples)
+{
+  switch (format) {
+    case GST_AUDIO_FORMAT_F32:
+      apply_gains_f32 ((gfloat *) data, gains, samples);
+      break;
+    case GST_AUDIO_FORMAT_S16:
+      apply_gains_s16 ((gint16 *) data, gains, samples);
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+/* The planes of a mapped buffer of main audio; one for interleaved audio,
+ * or one per channel. */
+typedef struct
+{
+  guint n_planes;
+  guint8 **planes;
+#if GST_CHECK_VERSION(1,16,0)
+  GstAudioBuffer abuf;
+#else
+  GstBuffer *buffer;
+  GstMapInfo map;
+#endif
+} GstAdcontrolPlanes;
+
+static gboolean
+gst_adcontrol_map_planes (GstAdcontrol *self, GstBuffer *buf,
+    GstMapFlags flags, GstAdcontrolPlanes *planes)
+{
+#if GST_CHECK_VERSION(1,16,0)
+  // the planes of non-interleaved audio are found from its GstAudioMeta,
+  // if any,
+  if (!gst_audio_buffer_map (&planes->abuf, &self->info, buf, flags)) {
+    return FALSE;
+  }
+  planes->n_planes = planes->abuf.n_planes;
+  planes->planes = (guint8 **) planes->abuf.planes;
+#else
+  // older GStreamer knows only tightly-packed planes,
+  if (!gst_buffer_map (buf, &planes->map, flags)) {
+    return FALSE;
+  }
+  planes->buffer = buf;
+  planes->n_planes =
+      GST_AUDIO_INFO_LAYOUT (&self->info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED
+      ? GST_AUDIO_INFO_CHANNELS (&self->info) : 1;
+  const gsize plane_size = planes->map.size / planes->n_planes;
+  planes->planes = g_new (guint8 *, planes->n_planes);
+  for (guint p = 0; p < planes->n_planes; p++) {
+    planes->planes[p] = planes->map.data + p * plane_size;
+  }
+#endif
+  return TRUE;
+}
+
+/* Post the error for a buffer of main audio which could not be mapped */
+static void
+gst_adcontrol_map_failed (GstAdcontrol *self, const gchar *what)
+{
+  GST_ELEMENT_ERROR (self, STREAM, FAILED, ("Internal data stream error."),
+      ("could not map %s", what));
+}
+
+static void
+gst_adcontrol_unmap_planes (GstAdcontrolPlanes *planes)
+{
+#if GST_CHECK_VERSION(1,16,0)
+  gst_audio_buffer_unmap (&planes->abuf);
+#else
+  g_free (planes->planes);
+  gst_buffer_unmap (planes->buffer, &planes->map);
+#endif
+}
+
+/* A new buffer of 'frames' frames of main audio, with tightly-packed planes
+ * if it is non-interleaved. */
+static GstBuffer *
+gst_adcontrol_new_audio_buffer (GstAdcontrol *self, gsize frames)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL,
+      frames * GST_AUDIO_INFO_BPF (&self->info), NULL);
+#if GST_CHECK_VERSION(1,16,0)
+  if (GST_AUDIO_INFO_LAYOUT (&self->info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED) {
+    gst_buffer_add_audio_meta (buf, &self->info, frames, NULL);
+  }
+#endif
+  return buf;
+}
+
+/* Take a reference to gain_src, if it has been requested, first readying
+ * its stream state if the pad is new. */
+static GstPad *
+gst_adcontrol_ref_gain_src (GstAdcontrol *self)
+{
+  GST_OBJECT_LOCK (self);
+  GstPad *gain_src = self->gain_src ? gst_object_ref (self->gain_src) : NULL;
+  gboolean reset = self->gain_reset;
+  self->gain_reset = FALSE;
+  GST_OBJECT_UNLOCK (self);
+
+  if (gain_src && reset) {
+    gchar *stream_id = gst_pad_create_stream_id (gain_src, GST_ELEMENT (self), "gain");
+    gst_pad_push_event (gain_src, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+    self->gain_negotiated_rate = 0;
+    self->gain_need_segment = TRUE;
+  }
+  return gain_src;
+}
+
+/* A buffer of 'size' bytes for the gain signal, from a pool which is
+ * replaced by a larger one whenever the main audio buffers (and so the gain
+ * buffers) grow beyond it.  The pool is used only by the main streaming
+ * thread. */
+static GstBuffer *
+gst_adcontrol_alloc_gains (GstAdcontrol *self, GstPad *gain_src, gsize size)
+{
+  if (self->gain_pool && self->gain_pool_size < size) {
+    gst_adcontrol_free_gain_pool (self);
+  }
+  if (self->gain_pool == NULL) {
+    // with some headroom, so that main audio buffers which vary a little
+    // in size don't each replace the pool,
+    const guint pool_size = size * 2;
+    GstBufferPool *pool = gst_buffer_pool_new ();
+    GstStructure *config = gst_buffer_pool_get_config (pool);
+    GstCaps *caps = gst_pad_get_current_caps (gain_src);
+    gst_buffer_pool_config_set_params (config, caps, pool_size, 0, 0);
+    if (caps) {
+      gst_caps_unref (caps);
+    }
+    if (!gst_buffer_pool_set_config (pool, config)
+        || !gst_buffer_pool_set_active (pool, TRUE)) {
+      GST_WARNING_OBJECT (self, "could not configure a pool for the gain");
+      gst_object_unref (pool);
+      return gst_buffer_new_allocate (NULL, size, NULL);
+    }
+    self->gain_pool = pool;
+    self->gain_pool_size = pool_size;
+  }
+
+  GstBuffer *out = NULL;
+  if (gst_buffer_pool_acquire_buffer (self->gain_pool, &out, NULL) != GST_FLOW_OK) {
+    return gst_buffer_new_allocate (NULL, size, NULL);
+  }
+  gst_buffer_set_size (out, size);
+  return out;
+}
+
+/* A buffer of 'size' bytes of unity gain for passthrough, sharing the
+ * memory of one filled only when it first grows to that size. */
+static GstBuffer *
+gst_adcontrol_unity_gains (GstAdcontrol *self, gsize size)
+{
+  if (self->gain_unity == NULL || gst_buffer_get_size (self->gain_unity) < size) {
+    gst_buffer_replace (&self->gain_unity, NULL);
+    // with headroom, as for the pool,
+    const gsize unity_size = size * 2;
+    self->gain_unity = gst_buffer_new_allocate (NULL, unity_size, NULL);
+    GstMapInfo map;
+    gst_buffer_map (self->gain_unity, &map, GST_MAP_WRITE);
+    gfloat *data = (gfloat *) map.data;
+    for (gsize i = 0; i < unity_size / sizeof (gfloat); i++) {
+      data[i] = 1.0f;
+    }
+    gst_buffer_unmap (self->gain_unity, &map);
+  }
+  return gst_buffer_copy_region (self->gain_unity, GST_BUFFER_COPY_MEMORY,
+      0, size);
+}
+
+/* Push the gains of a buffer of main audio starting at running time 'ts' to
+ * gain_src, sampling the gain of the nearest main audio frame at each
+ * multiple of 1/gain-rate seconds ('gains' being NULL where the gain is
+ * unity).  The output segment is in running time, so that it lines up with
+ * the main audio wherever it ends up. */
+static GstFlowReturn
+gst_adcontrol_push_gains (GstAdcontrol *self, GstPad *gain_src,
+    const gfloat *gains, GstClockTime ts, guint frames)
+{
+  const gint rate = GST_AUDIO_INFO_RATE (&self->info);
+  const gint channels = GST_AUDIO_INFO_CHANNELS (&self->info);
+
+  GST_OBJECT_LOCK (self);
+  const guint gain_rate = self->gain_rate;
+  GST_OBJECT_UNLOCK (self);
+
+  if (gain_rate != self->gain_negotiated_rate) {
+    GstAudioInfo info;
+    gst_audio_info_set_format (&info, GST_AUDIO_FORMAT_F32, gain_rate, channels,
+        GST_AUDIO_INFO_IS_UNPOSITIONED (&self->info) ? NULL : self->info.position);
+    GstCaps *caps = gst_audio_info_to_caps (&info);
+    gst_pad_push_event (gain_src, gst_event_new_caps (caps));
+    gst_caps_unref (caps);
+    self->gain_negotiated_rate = gain_rate;
+    self->gain_next = GST_BUFFER_OFFSET_NONE;
+    // buffers of the old pool carry the old caps,
+    gst_adcontrol_free_gain_pool (self);
+  }
+  if (self->gain_need_segment) {
+    GstSegment segment;
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (gain_src, gst_event_new_segment (&segment));
+    self->gain_need_segment = FALSE;
+  }
+
+  const GstClockTime end = ts + gst_util_uint64_scale (frames, GST_SECOND, rate);
+  const guint64 first = gst_util_uint64_scale_ceil (ts, gain_rate, GST_SECOND);
+  const guint64 last = gst_util_uint64_scale_ceil (end, gain_rate, GST_SECOND);
+  gboolean discont = FALSE;
+  // allowing for rounding, main audio which does not carry on from the
+  // last buffer restarts the gain signal,
+  if (self->gain_next == GST_BUFFER_OFFSET_NONE
+      || self->gain_next + 1 < first || self->gain_next > first + 1) {
+    self->gain_next = first;
+    discont = TRUE;
+  }
+  if (last <= self->gain_next) {
+    return GST_FLOW_OK;
+  }
+
+  const guint n = last - self->gain_next;
+  const gsize size = n * channels * sizeof (gfloat);
+  GstBuffer *out;
+  if (gains == NULL) {
+    // in passthrough the gain is constant, so nothing need be sampled,
+    out = gst_adcontrol_unity_gains (self, size);
+  } else {
+    out = gst_adcontrol_alloc_gains (self, gain_src, size);
+    GstMapInfo map;
+    gst_buffer_map (out, &map, GST_MAP_WRITE);
+    gfloat *data = (gfloat *) map.data;
+    for (guint i = 0; i < n; i++) {
+      GstClockTime t = gst_util_uint64_scale (self->gain_next + i, GST_SECOND, gain_rate);
+      guint f = t <= ts ? 0 : gst_util_uint64_scale (t - ts, rate, GST_SECOND);
+      f = MIN (f, frames - 1);
+      for (gint c = 0; c < channels; c++) {
+        data[i * channels + c] = gain_at (self, gains, f, c, frames);
+      }
+    }
+    gst_buffer_unmap (out, &map);
+  }
+
+  GST_BUFFER_OFFSET (out) = self->gain_next;
+  GST_BUFFER_OFFSET_END (out) = last;
+  GST_BUFFER_PTS (out) = gst_util_uint64_scale (self->gain_next, GST_SECOND, gain_rate);
+  GST_BUFFER_DURATION (out)
+    = gst_util_uint64_scale (last, GST_SECOND, gain_rate) - GST_BUFFER_PTS (out);
+  if (discont) {
+    GST_BUFFER_FLAG_SET (out, GST_BUFFER_FLAG_DISCONT);
+  }
+  self->gain_next = last;
+
+  return gst_pad_push (gain_src, out);
+}
+
+/* Hold main audio from running time 'ts' to 'end' until the descriptors of
+ * the track active at 'end' have reached it, so that its fade is known
+ * before it is applied.  Only while PLAYING is there a clock to bound the
+ * wait against: it lasts until the clock reaches the running time at which
+ * the audio is due downstream, 'ts' plus 'descriptor_wait', and is not
+ * repeated for a track whose descriptors have stopped (until they
+ * resume). */
+static void
+gst_adcontrol_wait_descriptors (GstAdcontrol *self, GstClockTime ts,
+    GstClockTime end)
+{
+  GST_OBJECT_LOCK (self);
+  while (!self->main_flushing) {
+    // the track may be switched or released while waiting,
+    GstAdcontrolTrack *track =
+        gst_adcontrol_find_track (self, gst_adcontrol_track_at (self, end));
+    if (track == NULL || track->eos || track->starved
+        || !gst_pad_is_linked (track->pad)
+        || (GST_CLOCK_TIME_IS_VALID (track->position) && track->position >= end)) {
+      break;
+    }
+    // when not PLAYING (or about to stop), running time doesn't advance,
+    // and prerolling mustn't depend on descriptors which may never come,
+    GstClock *clock = GST_ELEMENT_CLOCK (self);
+    if (clock == NULL || GST_STATE (self) != GST_STATE_PLAYING
+        || GST_STATE_TARGET (self) != GST_STATE_PLAYING) {
+      break;
+    }
+    const GstClockTime deadline = GST_ELEMENT_CAST (self)->base_time + ts
+        + self->descriptor_wait;
+    const GstClockTime now = gst_clock_get_time (clock);
+    if (now >= deadline) {
+      GST_DEBUG_OBJECT (self, "no descriptors on track %u up to %"
+          GST_TIME_FORMAT "; no longer waiting for them", track->index,
+          GST_TIME_ARGS (end));
+      track->starved = TRUE;
+      break;
+    }
+    // the clock is read again on waking, so the monotonic time only needs
+    // to be near it,
+    g_cond_wait_until (&self->descriptor_cond, GST_OBJECT_GET_LOCK (self),
+        g_get_monotonic_time () + (gint64) ((deadline - now) / GST_USECOND) + 1);
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* Fade a buffer of main audio and push it */
+static GstFlowReturn
+gst_adcontrol_process (GstAdcontrol *self, GstBuffer *buf)
+{
+  const guint frames = gst_buffer_get_size (buf) / GST_AUDIO_INFO_BPF (&self->info);
+  GstClockTime ts = gst_segment_to_running_time (&self->main_segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+  if (frames == 0 || !GST_CLOCK_TIME_IS_VALID (ts)) {
+    return gst_pad_push (self->main_src, buf);
+  }
+  gst_adcontrol_wait_descriptors (self, ts, ts + gst_util_uint64_scale (frames,
+          GST_SECOND, GST_AUDIO_INFO_RATE (&self->info)));
+
+  const gboolean fading = compute_gains (self, ts, frames);
+  if (fading == self->passthrough) {
+    GST_DEBUG_OBJECT (self, "%s passthrough at %" GST_TIME_FORMAT,
+        fading ? "leaving" : "entering", GST_TIME_ARGS (ts));
+    self->passthrough = !fading;
+  }
+
+  GstPad *gain_src = gst_adcontrol_ref_gain_src (self);
+  if (gain_src) {
+    GstFlowReturn ret = gst_adcontrol_push_gains (self, gain_src,
+        fading ? self->gains : NULL, ts, frames);
+    gst_object_unref (gain_src);
+    // the main audio keeps flowing whether or not the gain is wanted, but
+    // errors are not to be ignored,
+    if (ret < GST_FLOW_EOS) {
+      gst_buffer_unref (buf);
+      return ret;
+    }
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->main_position = ts;
+  GST_OBJECT_UNLOCK (self);
+
+  // at unity gain the buffer goes out untouched, which avoids a copy if
+  // it's shared (e.g. after a tee),
+  if (!fading) {
+    return gst_pad_push (self->main_src, buf);
+  }
+
+  buf = gst_buffer_make_writable (buf);
+  const GstAudioFormat format = GST_AUDIO_INFO_FORMAT (&self->info);
+  const guint samples = frames * GST_AUDIO_INFO_CHANNELS (&self->info);
+  GstAdcontrolPlanes planes;
+  if (!gst_adcontrol_map_planes (self, buf, GST_MAP_READWRITE, &planes)) {
+    gst_adcontrol_map_failed (self, "main audio to fade");
+    gst_buffer_unref (buf);
+    return GST_FLOW_ERROR;
+  }
+  const guint plane_samples = samples / planes.n_planes;
+  for (guint p = 0; p < planes.n_planes; p++) {
+    apply_gains (format, planes.planes[p], self->gains + p * plane_samples,
+        plane_samples);
+  }
+  gst_adcontrol_unmap_planes (&planes);
+
+  return gst_pad_push (self->main_src, buf);
+}
+
+/* Swap 'size' bytes between the delay ring and a buffer being delayed in
+ * place; 'restrict' letting the compiler vectorise it. */
+static void
+swap_bytes (guint8 *restrict a, guint8 *restrict b, gsize size)
+{
+  for (gsize i = 0; i < size; i++) {
+    guint8 t = a[i];
+    a[i] = b[i];
+    b[i] = t;
+  }
+}
+
+/* Copy 'frames' frames of 'width' bytes out of a plane of the delay ring,
+ * from frame 'pos', in at most two segments. */
+static void
+ring_read (const guint8 *ring, gsize ring_frames, gsize pos, gsize width,
+    guint8 *data, gsize frames)
+{
+  const gsize first = MIN (frames, ring_frames - pos);
+  memcpy (data, ring + pos * width, first * width);
+  memcpy (data + first * width, ring, (frames - first) * width);
+}
+
+static void
+ring_write (guint8 *ring, gsize ring_frames, gsize pos, gsize width,
+    const guint8 *data, gsize frames)
+{
+  const gsize first = MIN (frames, ring_frames - pos);
+  memcpy (ring + pos * width, data, first * width);
+  memcpy (ring, data + first * width, (frames - first) * width);
+}
+
+/* Put a buffer of main audio through the delay ring, giving in 'result' a
+ * buffer holding the audio from 'delay' earlier and timestamped
+ * accordingly, or NULL if all of it is still held.  Once the ring is full a
+ * writable buffer is delayed in place, by exchanging its audio with the
+ * ring's; otherwise the delayed audio is copied into a new buffer, which
+ * avoids copying a shared buffer only to overwrite it. */
+static GstFlowReturn
+gst_adcontrol_delay (GstAdcontrol *self, GstBuffer *buf, GstBuffer **result)
+{
+  const gint rate = GST_AUDIO_INFO_RATE (&self->info);
+  const gsize ring_frames = self->delay_frames;
+  GstAdcontrolPlanes in;
+
+  *result = NULL;
+  if (!gst_adcontrol_map_planes (self, buf, GST_MAP_READ, &in)) {
+    gst_adcontrol_map_failed (self, "main audio to delay");
+    gst_buffer_unref (buf);
+    return GST_FLOW_ERROR;
+  }
+  // each plane of the ring holds 'ring_frames' frames of one plane of the
+  // audio,
+  const gsize width = GST_AUDIO_INFO_BPF (&self->info) / in.n_planes;
+  const gsize frames = gst_buffer_get_size (buf) / GST_AUDIO_INFO_BPF (&self->info);
+  const gsize held = self->delay_filled + frames;
+  const gsize out_frames = held > ring_frames ? held - ring_frames : 0;
+  const GstClockTime pts = GST_BUFFER_PTS (buf);
+
+  GstBuffer *out = NULL;
+  if (self->delay_filled == ring_frames && gst_buffer_is_writable (buf)) {
+    gst_adcontrol_unmap_planes (&in);
+    if (!gst_adcontrol_map_planes (self, buf, GST_MAP_READWRITE, &in)) {
+      gst_adcontrol_map_failed (self, "main audio to delay");
+      gst_buffer_unref (buf);
+      return GST_FLOW_ERROR;
+    }
+    for (guint p = 0; p < in.n_planes; p++) {
+      guint8 *ring = self->delay_ring + p * ring_frames * width;
+      guint8 *data = in.planes[p];
+      gsize pos = self->delay_ring_pos;
+      for (gsize left = frames; left > 0;) {
+        const gsize n = MIN (left, ring_frames - pos);
+        swap_bytes (ring + pos * width, data, n * width);
+        data += n * width;
+        left -= n;
+        pos = (pos + n) % ring_frames;
+      }
+    }
+    gst_adcontrol_unmap_planes (&in);
+    self->delay_ring_pos = (self->delay_ring_pos + frames) % ring_frames;
+    out = buf;
+  } else {
+    // the oldest audio held goes out first, followed by as much of this
+    // buffer as the ring has no room for, and the rest of it is held,
+    const gsize from_ring = MIN (self->delay_filled, out_frames);
+    const gsize from_buf = out_frames - from_ring;
+    GstAdcontrolPlanes planes;
+    if (out_frames > 0) {
+      out = gst_adcontrol_new_audio_buffer (self, out_frames);
+      if (!gst_adcontrol_map_planes (self, out, GST_MAP_WRITE, &planes)) {
+        gst_adcontrol_map_failed (self, "delayed main audio");
+        gst_buffer_unref (out);
+        gst_adcontrol_unmap_planes (&in);
+        gst_buffer_unref (buf);
+        return GST_FLOW_ERROR;
+      }
+    }
+    for (guint p = 0; p < in.n_planes; p++) {
+      guint8 *ring = self->delay_ring + p * ring_frames * width;
+      if (out) {
+        ring_read (ring, ring_frames, self->delay_ring_pos, width,
+            planes.planes[p], from_ring);
+        memcpy (planes.planes[p] + from_ring * width, in.planes[p], from_buf * width);
+      }
+      ring_write (ring, ring_frames,
+          (self->delay_ring_pos + self->delay_filled) % ring_frames, width,
+          in.planes[p] + from_buf * width, frames - from_buf);
+    }
+    if (out) {
+      gst_adcontrol_unmap_planes (&planes);
+      gst_buffer_copy_into (out, buf, GST_BUFFER_COPY_FLAGS, 0, -1);
+    }
+    gst_adcontrol_unmap_planes (&in);
+    gst_buffer_unref (buf);
+    self->delay_ring_pos = (self->delay_ring_pos + from_ring) % ring_frames;
+    self->delay_filled = held - out_frames;
+  }
+
+  // the output ends where the audio held in the ring begins,
+  if (GST_CLOCK_TIME_IS_VALID (pts)) {
+    self->delay_end_pts = pts + gst_util_uint64_scale (frames, GST_SECOND, rate);
+  }
+  if (out == NULL) {
+    return GST_FLOW_OK;
+  }
+  const GstClockTime duration = gst_util_uint64_scale (out_frames, GST_SECOND, rate);
+  if (GST_CLOCK_TIME_IS_VALID (pts)) {
+    const GstClockTime delay = gst_util_uint64_scale (ring_frames, GST_SECOND, rate);
+    GstClockTime start = self->delay_end_pts > delay ? self->delay_end_pts - delay : 0;
+    GST_BUFFER_PTS (out) = start > duration ? start - duration : 0;
+  }
+  GST_BUFFER_DURATION (out) = duration;
+  if (out_frames < frames) {
+    // the first audio out after the ring has primed,
+    GST_BUFFER_FLAG_SET (out, GST_BUFFER_FLAG_DISCONT);
+  }
+  *result = out;
+  return GST_FLOW_OK;
+}
+
+/* Push out the audio still held in the delay ring, at the end of the
+ * stream */
+static GstFlowReturn
+gst_adcontrol_drain_delay (GstAdcontrol *self)
+{
+  const gint rate = GST_AUDIO_INFO_RATE (&self->info);
+  const gsize frames = self->delay_filled;
+
+  if (frames == 0) {
+    return GST_FLOW_OK;
+  }
+  GstBuffer *buf = gst_adcontrol_new_audio_buffer (self, frames);
+  GstAdcontrolPlanes planes;
+  if (!gst_adcontrol_map_planes (self, buf, GST_MAP_WRITE, &planes)) {
+    // the EOS handler posts the error,
+    GST_WARNING_OBJECT (self, "could not map delayed main audio");
+    gst_buffer_unref (buf);
+    return GST_FLOW_ERROR;
+  }
+  const gsize width = GST_AUDIO_INFO_BPF (&self->info) / planes.n_planes;
+  for (guint p = 0; p < planes.n_planes; p++) {
+    ring_read (self->delay_ring + p * self->delay_frames * width,
+        self->delay_frames, self->delay_ring_pos, width, planes.planes[p], frames);
+  }
+  gst_adcontrol_unmap_planes (&planes);
+  self->delay_ring_pos = 0;
+  self->delay_filled = 0;
+
+  const GstClockTime duration = gst_util_uint64_scale (frames, GST_SECOND, rate);
+  if (GST_CLOCK_TIME_IS_VALID (self->delay_end_pts)) {
+    GST_BUFFER_PTS (buf) = self->delay_end_pts - MIN (duration, self->delay_end_pts);
+  }
+  GST_BUFFER_DURATION (buf) = duration;
+  GST_DEBUG_OBJECT (self, "draining %" GST_TIME_FORMAT " of delayed audio",
+      GST_TIME_ARGS (duration));
+  return gst_adcontrol_process (self, buf);
+}
+
+/* Take any descriptors newly published in shared memory into the timeline
+ * of track 0.  The segment is opened on first use (and again on any change
+ * of name), and read from the newest descriptor applying at or before the
+ * current clock time. */
+static void
+gst_adcontrol_poll_shm (GstAdcontrol *self)
+{
+  GST_OBJECT_LOCK (self);
+  gboolean changed = self->shm_changed;
+  self->shm_changed = FALSE;
+  gchar *name = changed || self->shm == NULL ? g_strdup (self->shm_name) : NULL;
+  // track 0 belongs to the always-present ad_sink, so outlives this call,
+  GstAdcontrolTrack *track = gst_adcontrol_find_track (self, 0);
+  GST_OBJECT_UNLOCK (self);
+  g_return_if_fail (track != NULL);
+
+  if (changed) {
+    if (self->shm) {
+      gst_ad_shm_close (self->shm);
+      self->shm = NULL;
+    }
+    self->shm_retry_time = 0;
+  }
+  if (self->shm == NULL) {
+    const gint64 now = g_get_monotonic_time ();
+    if (name == NULL || now < self->shm_retry_time) {
+      g_free (name);
+      return;
+    }
+    GError *error = NULL;
+    self->shm = gst_ad_shm_open (name, &error);
+    if (self->shm == NULL) {
+      GST_DEBUG_OBJECT (self, "%s", error->message);
+      g_clear_error (&error);
+      self->shm_retry_time = now + SHM_RETRY_INTERVAL;
+      g_free (name);
+      return;
+    }
+    GST_INFO_OBJECT (self, "reading descriptors from %s", name);
+    GstClock *clock = gst_element_get_clock (GST_ELEMENT (self));
+    if (clock) {
+      self->shm_index = gst_ad_shm_find (self->shm, gst_clock_get_time (clock));
+      gst_object_unref (clock);
+    } else {
+      self->shm_index = gst_ad_shm_get_write_index (self->shm);
+    }
+  }
+  g_free (name);
+
+  const GstClockTime base_time = gst_element_get_base_time (GST_ELEMENT (self));
+  GstClockTime clock_time;
+  guint8 data[GST_AD_SHM_DESCRIPTOR_SIZE];
+  gsize size;
+  while (gst_ad_shm_read (self->shm, &self->shm_index, &clock_time, data, &size)) {
+    if (size < 9) {
+      continue;
+    }
+    // a descriptor from before this pipeline started (taken up on opening
+    // the segment) applies from its start,
+    gst_adcontrol_handle_descriptor (self, track,
+        clock_time > base_time ? clock_time - base_time : 0, data, size);
+  }
+}
+
+/* Poll shared memory for descriptors until told to stop.  Only while
+ * PLAYING is the base time (and so the running time of each descriptor)
+ * known; until then descriptors are left in the ring. */
+static gpointer
+gst_adcontrol_shm_loop (gpointer data)
+{
+  GstAdcontrol *self = GST_ADCONTROL (data);
+
+  GST_OBJECT_LOCK (self);
+  while (!self->shm_stop) {
+    // with no segment named, there's nothing to do until one is,
+    const gboolean wanted = self->shm_name != NULL || self->shm_changed;
+    const gboolean playing = GST_STATE (self) == GST_STATE_PLAYING;
+    GST_OBJECT_UNLOCK (self);
+    if (wanted && playing) {
+      gst_adcontrol_poll_shm (self);
+    }
+    GST_OBJECT_LOCK (self);
+    if (self->shm_stop) {
+      break;
+    }
+    if (wanted) {
+      g_cond_wait_until (&self->shm_cond, GST_OBJECT_GET_LOCK (self),
+          g_get_monotonic_time () + SHM_POLL_INTERVAL);
+    } else {
+      g_cond_wait (&self->shm_cond, GST_OBJECT_GET_LOCK (self));
+    }
+  }
+  GST_OBJECT_UNLOCK (self);
+  return NULL;
+}
+
+static void
+gst_adcontrol_start_shm (GstAdcontrol *self)
+{
+  GST_OBJECT_LOCK (self);
+  self->shm_stop = FALSE;
+  // the segment is opened afresh each time,
+  self->shm_changed = TRUE;
+  GST_OBJECT_UNLOCK (self);
+  self->shm_thread = g_thread_new ("adcontrol-shm", gst_adcontrol_shm_loop, self);
+}
+
+static void
+gst_adcontrol_stop_shm (GstAdcontrol *self)
+{
+  if (self->shm_thread == NULL) {
+    return;
+  }
+  GST_OBJECT_LOCK (self);
+  self->shm_stop = TRUE;
+  g_cond_signal (&self->shm_cond);
+  GST_OBJECT_UNLOCK (self);
+  g_thread_join (self->shm_thread);
+  self->shm_thread = NULL;
+  if (self->shm) {
+    gst_ad_shm_close (self->shm);
+    self->shm = NULL;
+  }
+}
+
+static GstFlowReturn
+gst_adcontrol_main_chain (GstPad * pad, GstObject * parent, GstBuffer *buf)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+
+  if (GST_AUDIO_INFO_FORMAT (&self->info) == GST_AUDIO_FORMAT_UNKNOWN) {
+    gst_buffer_unref (buf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+  if (self->delay_ring_size > 0) {
+    GstFlowReturn ret = gst_adcontrol_delay (self, buf, &buf);
+    if (buf == NULL) {
+      return ret;
+    }
+  }
+  return gst_adcontrol_process (self, buf);
+}
+
+/* gain_src is not an internal link of main_sink, so the events it needs are
+ * forwarded to it here (FLUSH_START arriving outside the streaming thread,
+ * so without touching the gain stream state). */
+static void
+gst_adcontrol_forward_to_gain_src (GstAdcontrol *self, GstEvent *event)
+{
+  GST_OBJECT_LOCK (self);
+  GstPad *gain_src = self->gain_src ? gst_object_ref (self->gain_src) : NULL;
+  GST_OBJECT_UNLOCK (self);
+  if (gain_src) {
+    gst_pad_push_event (gain_src, gst_event_ref (event));
+    gst_object_unref (gain_src);
+  }
+}
+
+static gboolean
+gst_adcontrol_main_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS: {
+      GstCaps *caps;
+      gst_event_parse_caps (event, &caps);
+      if (!gst_adcontrol_set_caps (self, caps)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &self->main_segment);
+      break;
+    case GST_EVENT_EOS:
+      // the audio held in the delay ring would otherwise be lost,
+      if (self->delay_ring_size > 0) {
+        GstFlowReturn ret = gst_adcontrol_drain_delay (self);
+        if (ret == GST_FLOW_FLUSHING) {
+          gst_event_unref (event);
+          return FALSE;
+        }
+        if (ret < GST_FLOW_EOS || ret == GST_FLOW_NOT_LINKED) {
+          // as for an error in the chain function, though EOS still
+          // follows,
+          GST_ELEMENT_ERROR (self, STREAM, FAILED,
+              ("Internal data stream error."),
+              ("draining the delayed main audio failed: %s",
+                  gst_flow_get_name (ret)));
+        }
+      }
+      gst_adcontrol_forward_to_gain_src (self, event);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&self->main_segment, GST_FORMAT_TIME);
+      self->delay_ring_pos = 0;
+      self->delay_filled = 0;
+      self->delay_end_pts = GST_CLOCK_TIME_NONE;
+      self->gain_need_segment = TRUE;
+      self->gain_next = GST_BUFFER_OFFSET_NONE;
+      GST_OBJECT_LOCK (self);
+      self->main_flushing = FALSE;
+      GST_OBJECT_UNLOCK (self);
+      gst_adcontrol_forward_to_gain_src (self, event);
+      break;
+    case GST_EVENT_FLUSH_START:
+      // release main audio waiting for descriptors,
+      GST_OBJECT_LOCK (self);
+      self->main_flushing = TRUE;
+      g_cond_broadcast (&self->descriptor_cond);
+      GST_OBJECT_UNLOCK (self);
+      gst_adcontrol_forward_to_gain_src (self, event);
+      break;
+    default:
+      break;
+  }
+  return gst_pad_event_default (pad, parent, event);
+}
+
+/* The main audio may only be faded once the descriptors covering it have
+ * arrived, so the latency of the descriptor branch is folded into the
+ * latency reported for the main audio.  The latency the pipeline then
+ * configures bounds how long main audio waits for them. */
+static gboolean
+gst_adcontrol_latency_query (GstAdcontrol *self, GstQuery * query)
+{
+  gboolean live;
+  GstClockTime min, max;
+
+  if (!gst_pad_peer_query (self->main_sink, query)) {
+    return FALSE;
+  }
+  gst_query_parse_latency (query, &live, &min, &max);
+  // main audio is held back by the delay,
+  GST_OBJECT_LOCK (self);
+  const GstClockTime delay = self->delay;
+  GST_OBJECT_UNLOCK (self);
+  min += delay;
+  if (GST_CLOCK_TIME_IS_VALID (max)) {
+    max += delay;
+  }
+
+  // any track may be switched to, so all are taken into account,
+  GST_OBJECT_LOCK (self);
+  GList *pads = NULL;
+  for (GList *l = self->tracks; l != NULL; l = l->next) {
+    GstAdcontrolTrack *track = l->data;
+    pads = g_list_prepend (pads, gst_object_ref (track->pad));
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  for (GList *l = pads; l != NULL; l = l->next) {
+    GstQuery *ad_query = gst_query_new_latency ();
+    if (gst_pad_peer_query (GST_PAD (l->data), ad_query)) {
+      gboolean ad_live;
+      GstClockTime ad_min, ad_max;
+      gst_query_parse_latency (ad_query, &ad_live, &ad_min, &ad_max);
+      GST_DEBUG_OBJECT (self, "main latency min %" GST_TIME_FORMAT
+          ", %s latency min %" GST_TIME_FORMAT, GST_TIME_ARGS (min),
+          GST_PAD_NAME (l->data), GST_TIME_ARGS (ad_min));
+      live |= ad_live;
+      min = MAX (min, ad_min);
+      if (!GST_CLOCK_TIME_IS_VALID (max)) {
+        max = ad_max;
+      } else if (GST_CLOCK_TIME_IS_VALID (ad_max)) {
+        max = MIN (max, ad_max);
+      }
+    }
+    gst_query_unref (ad_query);
+  }
+  g_list_free_full (pads, gst_object_unref);
+
+  gst_query_set_latency (query, live, min, max);
+  return TRUE;
+}
+
+/* Main audio may be held for descriptors until it is due downstream, which
+ * is as late as the latency configured for the pipeline allows */
+static gboolean
+gst_adcontrol_main_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_LATENCY) {
+    GstClockTime latency;
+    gst_event_parse_latency (event, &latency);
+    GST_DEBUG_OBJECT (self, "holding main audio for descriptors up to %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (latency));
+    GST_OBJECT_LOCK (self);
+    self->descriptor_wait = latency;
+    GST_OBJECT_UNLOCK (self);
+  }
+  return gst_pad_event_default (pad, parent, event);
+}
+
+/* The gain signal is produced alongside the faded main audio, and so has
+ * the same latency */
+static gboolean
+gst_adcontrol_gain_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+      return gst_adcontrol_latency_query (self, query);
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static gboolean
+gst_adcontrol_main_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS: {
+      // main audio passes through with its format unchanged, so accept
+      // whatever the other side accepts (within our template),
+      GstPad *other = pad == self->main_sink ? self->main_src : self->main_sink;
+      GstCaps *filter;
+      gst_query_parse_caps (query, &filter);
+      GstCaps *peer_caps = gst_pad_peer_query_caps (other, filter);
+      GstCaps *template_caps = gst_pad_get_pad_template_caps (pad);
+      GstCaps *caps = gst_caps_intersect (peer_caps, template_caps);
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      gst_caps_unref (template_caps);
+      gst_caps_unref (peer_caps);
+      return TRUE;
+    }
+    case GST_QUERY_LATENCY:
+      if (pad == self->main_src) {
+        return gst_adcontrol_latency_query (self, query);
+      }
+      break;
+    default:
+      break;
+  }
+  return gst_pad_query_default (pad, parent, query);
+}
+
+/* main_sink and main_src are linked to each other, and descriptor and
+ * description inputs and gain_src to nothing */
+static GstIterator *
+gst_adcontrol_iterate_internal_links (GstPad * pad, GstObject * parent)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+  GstPad *other;
+
+  if (pad == self->main_sink) {
+    other = self->main_src;
+  } else if (pad == self->main_src) {
+    other = self->main_sink;
+  } else {
+    return NULL;
+  }
+
+  GValue val = G_VALUE_INIT;
+  g_value_init (&val, GST_TYPE_PAD);
+  g_value_set_object (&val, other);
+  GstIterator *it = gst_iterator_new_single (GST_TYPE_PAD, &val);
+  g_value_unset (&val);
+  return it;
+}
+
+/* Description audio is measured in blocks of 10ms, of which only the first
+ * quarter is looked at; that is plenty to follow speech, and keeps the cost
+ * of following it to a fraction of a pass over the samples.  The measured
+ * part is contiguous, so the sums below still vectorise. */
+#define FALLBACK_BLOCKS_PER_SECOND 100
+#define FALLBACK_MEASURED_FRACTION 4
+// change in fallback gain (dB) needed before another control point is placed
+#define FALLBACK_GAIN_STEP 0.1
+// the deepest fade a descriptor can give (dB),
+#define FALLBACK_MIN_GAIN -76.5
+
+#define MEAN_SQUARE_LANES 8
+
+/* The compiler may not reorder a single floating-point sum, so it is split
+ * into MEAN_SQUARE_LANES independent partial sums, which the inner loop
+ * updates as one vector (given -ftree-vectorize, which configure adds). */
+static gdouble
+mean_square_f32 (const gfloat * restrict data, guint samples)
+{
+  gfloat acc[MEAN_SQUARE_LANES] = { 0.0f };
+  guint i = 0;
+  for (; i + MEAN_SQUARE_LANES <= samples; i += MEAN_SQUARE_LANES) {
+    for (guint j = 0; j < MEAN_SQUARE_LANES; j++) {
+      acc[j] += data[i + j] * data[i + j];
+    }
+  }
+  gdouble sum = 0.0;
+  for (guint j = 0; j < MEAN_SQUARE_LANES; j++) {
+    sum += acc[j];
+  }
+  for (; i < samples; i++) {
+    sum += data[i] * data[i];
+  }
+  return sum / samples;
+}
+
+/* Integer addition may be reordered freely, so this plain loop vectorises
+ * as it stands; 64 bits hold the sum of any practical number of squares
+ * exactly. */
+static gdouble
+mean_square_s16 (const gint16 * restrict data, guint samples)
+{
+  gint64 acc = 0;
+  for (guint i = 0; i < samples; i++) {
+    acc += (gint32) data[i] * data[i];
+  }
+  const gdouble full_scale = 32768.0;
+  return (gdouble) acc / samples / (full_scale * full_scale);
+}
+
+/* The fade (in dB) which a track's timeline gives at running time 'ts' */
+static gdouble
+fade_db_at (GstControlSource *fade_control, GstClockTime ts)
+{
+  gdouble linear;
+  if (!gst_control_source_get_value (fade_control, ts, &linear)) {
+    return 0.0;
+  }
+  if (linear <= 0.0) {
+    return FALLBACK_MIN_GAIN;
+  }
+  return MAX (FALLBACK_MIN_GAIN,
+      gst_stream_volume_convert_volume (GST_STREAM_VOLUME_FORMAT_LINEAR,
+          GST_STREAM_VOLUME_FORMAT_DB, linear));
+}
+
+static GstFlowReturn
+gst_adcontrol_description_chain (GstPad * pad, GstObject * parent, GstBuffer *buf)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+
+  GST_OBJECT_LOCK (self);
+  const gboolean enabled = self->fallback;
+  const GstClockTime timeout = self->fallback_timeout;
+  const GstClockTime attack = self->fallback_attack;
+  const GstClockTime release = self->fallback_release;
+  const gdouble depth = self->fallback_depth;
+  const gdouble threshold = self->fallback_threshold;
+  GST_OBJECT_UNLOCK (self);
+
+  GstClockTime ts = gst_segment_to_running_time (&self->description_segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+  if (!enabled || !GST_CLOCK_TIME_IS_VALID (ts)
+      || GST_AUDIO_INFO_FORMAT (&self->description_info) == GST_AUDIO_FORMAT_UNKNOWN) {
+    gst_buffer_unref (buf);
+    return GST_FLOW_OK;
+  }
+  if (!GST_CLOCK_TIME_IS_VALID (self->description_start)) {
+    self->description_start = ts;
+  }
+
+  GstMapInfo map;
+  if (!gst_buffer_map (buf, &map, GST_MAP_READ)) {
+    gst_buffer_unref (buf);
+    return GST_FLOW_ERROR;
+  }
+  const gint rate = GST_AUDIO_INFO_RATE (&self->description_info);
+  const gint channels = GST_AUDIO_INFO_CHANNELS (&self->description_info);
+  const guint frames = map.size / GST_AUDIO_INFO_BPF (&self->description_info);
+  const guint block_frames = MAX (1, rate / FALLBACK_BLOCKS_PER_SECOND);
+
+  for (guint start = 0; start < frames; start += block_frames) {
+    const guint n = MIN (block_frames, frames - start);
+    const GstClockTime block_ts = ts + gst_util_uint64_scale (start, GST_SECOND, rate);
+
+    // the description audio is taken to be that of the active track,
+    GST_OBJECT_LOCK (self);
+    const guint index = gst_adcontrol_track_at (self, block_ts);
+    GstControlSource *fade_control[GST_ADCONTROL_SPEAKERS_COUNT];
+    gboolean have_track = ref_track_controls (self, index, fade_control);
+    GstClockTime last_descriptor_time = have_track
+        ? gst_adcontrol_find_track (self, index)->last_descriptor_time
+        : GST_CLOCK_TIME_NONE;
+    // until a descriptor has been seen, the timeout runs from the start of
+    // the description audio, so that ducking doesn't start at once,
+    const GstClockTime since = GST_CLOCK_TIME_IS_VALID (last_descriptor_time)
+        ? last_descriptor_time : self->description_start;
+    gboolean stale = have_track && block_ts > since + timeout;
+    gboolean activated = stale && !self->fallback_active;
+    if (activated) {
+      self->fallback_active = TRUE;
+    } else if (!stale) {
+      // e.g. having switched to a track whose descriptors are arriving,
+      self->fallback_active = FALSE;
+    }
+    GST_OBJECT_UNLOCK (self);
+    if (!stale) {
+      if (have_track) {
+        unref_track_controls (fade_control);
+      }
+      continue;
+    }
+    if (activated) {
+      GST_INFO_OBJECT (self, "no descriptors on track %u since %" GST_TIME_FORMAT
+          "; starting fallback ducking", index,
+          GST_TIME_ARGS (last_descriptor_time));
+      // carry on from whatever fade the last descriptor left in place,
+      // rather than jumping back to 0dB,
+      self->fallback_gain
+          = fade_db_at (fade_control[GST_ADCONTROL_SPEAKERS_OTHER], block_ts);
+      self->fallback_point_gain = self->fallback_gain;
+    }
+
+    const guint measured = MAX (1, n / FALLBACK_MEASURED_FRACTION) * channels;
+    gdouble mean_square;
+    if (GST_AUDIO_INFO_FORMAT (&self->description_info) == GST_AUDIO_FORMAT_F32) {
+      mean_square = mean_square_f32 ((const gfloat *) map.data + start * channels, measured);
+    } else {
+      mean_square = mean_square_s16 ((const gint16 *) map.data + start * channels, measured);
+    }
+    const gdouble level = 10.0 * log10 (mean_square + 1e-20);
+
+    // one-pole smoothing toward the target gain, with the time constant
+    // depending on whether ducking is increasing or decreasing,
+    const gdouble target = level > threshold ? depth : 0.0;
+    const GstClockTime time_constant = target < self->fallback_gain ? attack : release;
+    const gdouble duration = (gdouble) n * GST_SECOND / rate;
+    const gdouble coeff = time_constant > 0 ? exp (-duration / time_constant) : 0.0;
+    self->fallback_gain = target + (self->fallback_gain - target) * coeff;
+    // settle exactly on 0dB once released, so that the main audio may
+    // pass through untouched,
+    if (target == 0.0 && fabs (self->fallback_gain) < FALLBACK_GAIN_STEP) {
+      self->fallback_gain = 0.0;
+    }
+
+    if (fabs (self->fallback_gain - self->fallback_point_gain) > FALLBACK_GAIN_STEP
+        || (self->fallback_gain == 0.0 && self->fallback_point_gain != 0.0)) {
+      gdouble gains_db[GST_ADCONTROL_SPEAKERS_COUNT];
+      for (int s = 0; s < GST_ADCONTROL_SPEAKERS_COUNT; s++) {
+        gains_db[s] = self->fallback_gain;
+      }
+      gst_adcontrol_set_gains (self, fade_control, block_ts, gains_db, FALSE);
+      self->fallback_point_gain = self->fallback_gain;
+    }
+    unref_track_controls (fade_control);
+  }
+
+  gst_buffer_unmap (buf, &map);
+  gst_buffer_unref (buf);
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_adcontrol_description_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstAdcontrol *self = GST_ADCONTROL (parent);
+  gboolean res = TRUE;
+
+  // description audio is only measured here, so none of its events go any
+  // further
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS: {
+      GstCaps *caps;
+      gst_event_parse_caps (event, &caps);
+      res = gst_audio_info_from_caps (&self->description_info, caps);
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &self->description_segment);
+      self->description_start = GST_CLOCK_TIME_NONE;
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&self->description_segment, GST_FORMAT_TIME);
+      self->description_start = GST_CLOCK_TIME_NONE;
+      break;
+    default:
+      break;
+  }
+  gst_event_unref (event);
+  return res;
 }
@@ -20,8 +20,10 @@
 #ifndef _GST_ADCONTROL_H_
 #define _GST_ADCONTROL_H_
 
-#include <gst/base/gstbasesink.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
 #include <gst/controller/gstinterpolationcontrolsource.h>
+#include "gstadshm.h"
 
 G_BEGIN_DECLS
 
@@ -34,20 +36,166 @@ G_BEGIN_DECLS
 typedef struct _GstAdcontrol GstAdcontrol;
 typedef struct _GstAdcontrolClass GstAdcontrolClass;
 
+// groups of main audio channels which may be given distinct gains by the
+// AD_gain_byte_* fields of an AD_descriptor,
+enum
+{
+  GST_ADCONTROL_SPEAKERS_OTHER,     // fade only (mono, LFE, unpositioned)
+  GST_ADCONTROL_SPEAKERS_CENTRE,
+  GST_ADCONTROL_SPEAKERS_FRONT,
+  GST_ADCONTROL_SPEAKERS_SURROUND,
+  GST_ADCONTROL_SPEAKERS_COUNT
+};
+
+// shape of the ramp between the gains of successive descriptors,
+typedef enum
+{
+  GST_ADCONTROL_RAMP_LINEAR,
+  GST_ADCONTROL_RAMP_S_CURVE,
+  GST_ADCONTROL_RAMP_STEP
+} GstAdcontrolRampShape;
+
+// a descriptor input, whose fade timeline is kept up to date whether or
+// not it is the track currently applied to the main audio,
+typedef struct _GstAdcontrolTrack
+{
+  guint index;
+  GstPad *pad;
+  GstSegment segment;
+  // timeline of linear gain for each group of speakers, in running time,
+  GstControlSource *fade_control[GST_ADCONTROL_SPEAKERS_COUNT];
+  GstClockTime last_descriptor_time;
+  // running time of the latest descriptor since the last flush, whether
+  // the descriptors have ended, and whether main audio gave up waiting
+  // for them (cleared by the next descriptor),
+  GstClockTime position;
+  gboolean eos;
+  gboolean starved;
+} GstAdcontrolTrack;
+
 struct _GstAdcontrol
 {
-  GstBaseSink base_adcontrol;
+  GstElement base_adcontrol;
 
-  GstElement *volume_element;
   GstPad *main_sink;
   GstPad *main_src;
-  GstPad *ad_sink;
-  GstControlSource *fade_control;
+  GstPad *description_sink;
+
+  // descriptor tracks; ad_sink is track 0 and each ad_sink_%u request pad
+  // adds another (the list and the track selection are protected by the
+  // object lock),
+  GList *tracks;
+  guint next_track;
+  guint active_track;
+  // a switch of track due at running time 'pending_time', if
+  // 'pending_time' is valid,
+  guint pending_track;
+  GstClockTime pending_time;
+  GstAdcontrolRampShape ramp_shape;
+
+  // main audio format, the speaker group of each of its channels, and the
+  // set of groups those make up (a bit per group),
+  GstAudioInfo info;
+  guint8 *speakers;
+  guint speaker_groups;
+
+  GstSegment main_segment;
+  // running time up to which main audio has been faded,
+  GstClockTime main_position;
+
+  // main audio is held until the active track's descriptors cover it, but
+  // only while PLAYING, and no longer than 'descriptor_wait' (the latency
+  // configured for the pipeline) past its running time; signalled whenever
+  // a track advances, ends or goes away (all protected by the object lock),
+  GCond descriptor_cond;
+  GstClockTime descriptor_wait;
+  gboolean main_flushing;
+
+  // serialises changes to the fade timelines, which descriptors and
+  // fallback ducking make from different streaming threads,
+  GMutex control_lock;
+
+  // optional output of the gain applied to the main audio as a low-rate
+  // control signal, timestamped in running time (the pad, the rate and
+  // 'gain_reset' are protected by the object lock),
+  GstPad *gain_src;
+  guint gain_rate;
+  gboolean gain_reset;
+  // state of the gain_src stream, used only by the main streaming thread;
+  // the rate in its caps, and the index of its next sample,
+  gboolean gain_need_segment;
+  guint gain_negotiated_rate;
+  guint64 gain_next;
+  // buffers for the gain signal, of 'gain_pool_size' bytes, and a buffer
+  // of unity gain whose memory is shared by the gain output in passthrough,
+  GstBufferPool *gain_pool;
+  gsize gain_pool_size;
+  GstBuffer *gain_unity;
+
+  // descriptors for track 0 published in shared memory by adshmsink, read
+  // by a thread of their own while the element is PAUSED or PLAYING (the
+  // name, 'shm_changed' and 'shm_stop' are protected by the object lock,
+  // and the rest is used only by that thread); the time to retry opening
+  // the segment is in microseconds of g_get_monotonic_time(),
+  gchar *shm_name;
+  gboolean shm_changed;
+  GThread *shm_thread;
+  GCond shm_cond;
+  gboolean shm_stop;
+  GstAdShm *shm;
+  guint32 shm_index;
+  gint64 shm_retry_time;
+
+  // lookahead delay of the main audio, and the ring of delayed audio
+  // (allocated when caps are set, and used only by the main streaming
+  // thread); 'delay_frames' frames of each plane of the audio, laid out
+  // one plane after another, of which the 'delay_filled' frames from frame
+  // 'delay_ring_pos' are held audio, oldest first,
+  GstClockTime delay;
+  guint delay_frames;
+  guint8 *delay_ring;
+  gsize delay_ring_size;
+  gsize delay_ring_pos;
+  gsize delay_filled;
+  // timestamp of the end of the last main audio buffer to enter the ring,
+  GstClockTime delay_end_pts;
+
+  // per-buffer scratch space; gains for each speaker group, and the gain
+  // of every sample (in the layout of the main audio),
+  gdouble *speaker_gains[GST_ADCONTROL_SPEAKERS_COUNT];
+  gfloat *gains;
+  guint scratch_frames;
+  // whether the last buffer of main audio was passed through untouched,
+  // the gain being unity throughout,
+  gboolean passthrough;
+
+  // fallback ducking driven by the level of the description audio, used
+  // while no descriptors are arriving (settings and state shared between
+  // streaming threads are protected by the object lock),
+  gboolean fallback;
+  GstClockTime fallback_timeout;
+  GstClockTime fallback_attack;
+  GstClockTime fallback_release;
+  gdouble fallback_depth;
+  gdouble fallback_threshold;
+  GstAudioInfo description_info;
+  GstSegment description_segment;
+  // running time of the first description audio of the segment, from which
+  // the timeout runs until a descriptor is seen (used only by the
+  // description streaming thread),
+  GstClockTime description_start;
+  gboolean fallback_active;
+  // current ducking, and that of the last control point placed, in dB,
+  gdouble fallback_gain;
+  gdouble fallback_point_gain;
 };
 
 struct _GstAdcontrolClass
 {
-  GstBaseSinkClass base_adcontrol_class;
+  GstElementClass base_adcontrol_class;
+
+  /* actions */
+  void (*switch_track) (GstAdcontrol *adcontrol, guint track, guint64 running_time);
 };
 
 GType gst_adcontrol_get_type (void);
@@ -0,0 +1,160 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstadpes.h"
+
+#define AD_TEXT_TAG "DTGAD"
+
+/* Returns the offset of the payload of the given transport packet, or 0 if
+ * it has none. */
+gsize
+ad_pes_payload_offset (const guint8 * packet)
+{
+  const int adaptation_field_control = (packet[3] >> 4) & 0x3;
+  if (!(adaptation_field_control & 0x1)) {
+    return 0;
+  }
+  gsize offset = 4;
+  if (adaptation_field_control & 0x2) {
+    offset += 1 + packet[4];
+  }
+  return offset < AD_PES_TS_PACKET_SIZE ? offset : 0;
+}
+
+/* Parse the PES header at the start of the given data, returning FALSE if
+ * it has no optional header, or if the header is not entirely within
+ * 'size' bytes. */
+gboolean
+ad_pes_parse_header (const guint8 * pes, gsize size, AdPesHeader * header)
+{
+  if (size < 9 || pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01) {
+    return FALSE;
+  }
+  const guint8 stream_id = pes[3];
+  switch (stream_id) {
+    case 0xbc:  // program_stream_map
+    case 0xbe:  // padding_stream
+    case 0xbf:  // private_stream_2
+    case 0xf0:  // ECM
+    case 0xf1:  // EMM
+    case 0xf2:  // DSMCC_stream
+    case 0xf8:  // ITU-T Rec. H.222.1 type E
+    case 0xff:  // program_stream_directory
+      // no optional PES header
+      return FALSE;
+  }
+  const guint8 flags = pes[7];
+  const gsize header_data_length = pes[8];
+  if (9 + header_data_length > size) {
+    return FALSE;
+  }
+  const guint8 *p = pes + 9;
+  const guint8 *end = p + header_data_length;
+
+  const int pts_dts_flags = flags >> 6;
+  if (pts_dts_flags & 0x2) {
+    if (p + 5 > end) {
+      return FALSE;
+    }
+    header->pts = ((guint64) (p[0] & 0x0e) << 29)
+        | ((guint64) p[1] << 22)
+        | ((guint64) (p[2] & 0xfe) << 14)
+        | ((guint64) p[3] << 7)
+        | ((guint64) p[4] >> 1);
+    p += 5;
+    if (pts_dts_flags == 0x3) {
+      if (p + 5 > end) {
+        return FALSE;
+      }
+      p += 5;  // DTS
+    }
+  } else {
+    header->pts = G_MAXUINT64;
+  }
+  // the optional fields preceding PES_extension, each of which must lie
+  // within the header,
+  static const struct {
+    guint8 flag;
+    guint8 size;
+  } fields[] = {
+    { 0x20, 6 },  // ESCR
+    { 0x10, 3 },  // ES_rate
+    { 0x08, 1 },  // DSM_trick_mode
+    { 0x04, 1 },  // additional_copy_info
+    { 0x02, 2 },  // previous_PES_CRC
+  };
+  for (guint i = 0; i < G_N_ELEMENTS (fields); i++) {
+    if (flags & fields[i].flag) {
+      if (p + fields[i].size > end) {
+        return FALSE;
+      }
+      p += fields[i].size;
+    }
+  }
+  header->extension = p - pes;
+  header->has_extension = flags & 0x01;
+  header->private_data = 0;
+  header->end = end - pes;
+  if (header->has_extension) {
+    if (p + 1 > end) {
+      return FALSE;
+    }
+    const guint8 extension_flags = *p++;
+    if (extension_flags & 0x80) {
+      if (p + AD_PES_PRIVATE_DATA_SIZE > end) {
+        return FALSE;
+      }
+      header->private_data = p - pes;
+    }
+  }
+  return TRUE;
+}
+
+gboolean
+ad_pes_is_descriptor (const guint8 * private_data)
+{
+  int descriptor_length = private_data[0] & 0x0f;
+  return descriptor_length >= 8
+      && memcmp (private_data + 1, AD_TEXT_TAG, strlen (AD_TEXT_TAG)) == 0;
+}
+
+/* Extend a 33-bit PTS to 64 bits, on the assumption that successive values
+ * are never more than half the wrap period apart.  'last_pts' holds the
+ * previous result, or G_MAXUINT64 initially. */
+guint64
+ad_pes_unwrap_pts (guint64 * last_pts, guint64 pts)
+{
+  if (*last_pts == G_MAXUINT64) {
+    *last_pts = pts;
+    return pts;
+  }
+  guint64 ext = (*last_pts & ~(AD_PES_PTS_WRAP - 1)) | pts;
+  if (ext + AD_PES_PTS_WRAP / 2 < *last_pts) {
+    ext += AD_PES_PTS_WRAP;
+  } else if (ext >= AD_PES_PTS_WRAP && ext > *last_pts + AD_PES_PTS_WRAP / 2) {
+    ext -= AD_PES_PTS_WRAP;
+  }
+  *last_pts = ext;
+  return ext;
+}
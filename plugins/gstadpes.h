@@ -0,0 +1,59 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_AD_PES_H_
+#define _GST_AD_PES_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Helpers for the AD_descriptor carried in the PES_private_data of the
+ * description audio of an MPEG transport stream (per "ETSI TS 101 154"),
+ * shared by adpesparse and adpesinject.  These are internal to the plugin,
+ * so are not given the gst_ prefix which it exports. */
+
+#define AD_PES_TS_PACKET_SIZE 188
+#define AD_PES_TS_SYNC_BYTE 0x47
+#define AD_PES_PRIVATE_DATA_SIZE 16
+#define AD_PES_PTS_WRAP (G_GUINT64_CONSTANT (1) << 33)
+
+typedef struct
+{
+  // 33-bit PTS, or G_MAXUINT64 if the packet has none,
+  guint64 pts;
+  // offset of the PES_extension flags, or of where they would be inserted
+  // if the header has no PES_extension,
+  gsize extension;
+  gboolean has_extension;
+  // offset of the PES_private_data, or 0 if there is none,
+  gsize private_data;
+  // offset of the first byte following the header,
+  gsize end;
+} AdPesHeader;
+
+gsize ad_pes_payload_offset (const guint8 * packet);
+gboolean ad_pes_parse_header (const guint8 * pes, gsize size,
+    AdPesHeader * header);
+gboolean ad_pes_is_descriptor (const guint8 * private_data);
+guint64 ad_pes_unwrap_pts (guint64 * last_pts, guint64 pts);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,800 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstadpesinject
+ *
+ * The adpesinject element writes Audio Description descriptors (such as
+ * those produced by whp198dec) into the PES_private_data of the PES
+ * headers of the description audio in an MPEG transport stream, per
+ * "ETSI TS 101 154", so that receivers may fade the main audio without
+ * decoding a WHP 198 signal.  adpesparse reads them back.
+ *
+ * It follows the muxer, rewriting the packets of the PID given by the
+ * "pid" property and passing all others untouched.  Where a PES header has
+ * no PES_private_data already, adding it lengthens the PES packet by up to
+ * 17 bytes; these are taken from any adaptation field stuffing in the
+ * transport packets carrying it, and failing that an extra transport
+ * packet follows them.  The continuity_counter of the PID is renumbered to
+ * suit.
+ *
+ * Extra packets raise the bitrate and move the packets after them, so they
+ * upset the muxer's PCR and T-STD buffer model.  Once null packets have
+ * been seen, marking the muxer as running at a constant bitrate, no extra
+ * packets are added at all: a descriptor is only written where the
+ * stuffing in the PES packet's own transport packets has room for it, and
+ * otherwise the PES packet is left as it was.
+ *
+ * Each PES packet carries the most recent descriptor whose timestamp is
+ * not later than its PTS, once the offset between PTS and running time is
+ * subtracted.  That offset is found from the first PES packet of the PID,
+ * against the running time of the buffer carrying it, unless "pts-offset"
+ * gives it.  Since descriptors are only available once fully decoded, the
+ * audio should be queued ahead of the muxer by at least the latency
+ * reported by the descriptor source.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=test.wav ! wavparse ! deinterleave name=d d.src_1 ! audioconvert ! whp198dec ! inject.ad_sink  d.src_0 ! queue max-size-time=200000000 ! audioconvert ! avenc_mp2 ! mpegaudioparse ! mux.sink_66  mpegtsmux name=mux ! adpesinject name=inject pid=66 ! filesink location=test.ts
+ * ]|
+ * Encode the description channel of a WAV file as MPEG-1 Layer II audio
+ * in a transport stream, with the descriptors from its WHP 198 channel in
+ * the PES headers
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include "gstadpesinject.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_adpesinject_debug_category);
+#define GST_CAT_DEFAULT gst_adpesinject_debug_category
+
+/* prototypes */
+
+
+static void gst_adpesinject_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_adpesinject_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_adpesinject_dispose (GObject * object);
+static void gst_adpesinject_finalize (GObject * object);
+
+static GstFlowReturn gst_adpesinject_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer);
+static gboolean gst_adpesinject_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static GstFlowReturn gst_adpesinject_ad_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer);
+static gboolean gst_adpesinject_ad_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static GstIterator *gst_adpesinject_iterate_internal_links (GstPad * pad,
+    GstObject * parent);
+
+enum
+{
+  PROP_0,
+  PROP_PID,
+  PROP_PTS_OFFSET
+};
+
+#define DEFAULT_PID -1
+#define DEFAULT_PTS_OFFSET GST_CLOCK_TIME_NONE
+
+#define NULL_PID 0x1fff
+
+#define TS_PAYLOAD_SIZE (AD_PES_TS_PACKET_SIZE - 4)
+
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_adpesinject_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true, packetsize = (int) 188")
+    );
+
+static GstStaticPadTemplate gst_adpesinject_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true, packetsize = (int) 188")
+    );
+
+static GstStaticPadTemplate gst_adpesinject_ad_sink_template =
+GST_STATIC_PAD_TEMPLATE ("ad_sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-tr_101_154_ad_descriptor")
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstAdpesinject, gst_adpesinject, GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (gst_adpesinject_debug_category, "adpesinject", 0,
+        "debug category for adpesinject element"));
+
+static void
+gst_adpesinject_class_init (GstAdpesinjectClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_adpesinject_src_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_adpesinject_sink_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_adpesinject_ad_sink_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "MPEG-TS Audio Description descriptor injector",
+      "Codec/Muxer",
+      "Writes Audio Description descriptors into the PES private data of the description audio of an MPEG transport stream",
+      "David Holroyd <dave@badgers-in-foil.co.uk>");
+
+  gobject_class->set_property = gst_adpesinject_set_property;
+  gobject_class->get_property = gst_adpesinject_get_property;
+  gobject_class->dispose = gst_adpesinject_dispose;
+  gobject_class->finalize = gst_adpesinject_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PID,
+      g_param_spec_int ("pid", "PID",
+          "PID of the description audio, or -1 to pass the stream through untouched",
+          -1, 0x1fff, DEFAULT_PID,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PTS_OFFSET,
+      g_param_spec_uint64 ("pts-offset", "PTS offset",
+          "Amount by which the muxer offsets PTS from running time, in nanoseconds, or GST_CLOCK_TIME_NONE to find it from the stream",
+          0, G_MAXUINT64, DEFAULT_PTS_OFFSET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+/* call with the object lock held */
+static void
+gst_adpesinject_reset_descriptors (GstAdpesinject *inject)
+{
+  inject->pending_head = 0;
+  inject->pending_count = 0;
+  inject->have_current = FALSE;
+}
+
+static void
+gst_adpesinject_reset_stream (GstAdpesinject *inject)
+{
+  gst_adapter_clear (inject->adapter);
+  g_byte_array_set_size (inject->out, 0);
+  g_byte_array_set_size (inject->carry, 0);
+  inject->rewriting = FALSE;
+  inject->pes_remaining = 0;
+  inject->have_cc = FALSE;
+  inject->last_pts = G_MAXUINT64;
+  gst_segment_init (&inject->segment, GST_FORMAT_TIME);
+  inject->stream_pts_offset = GST_CLOCK_TIME_NONE;
+  inject->cbr = FALSE;
+  inject->tentative = FALSE;
+  g_byte_array_set_size (inject->original, 0);
+}
+
+static void
+gst_adpesinject_init (GstAdpesinject * adpesinject)
+{
+  adpesinject->pid = DEFAULT_PID;
+  adpesinject->pts_offset = DEFAULT_PTS_OFFSET;
+  adpesinject->adapter = gst_adapter_new ();
+  adpesinject->out = g_byte_array_new ();
+  adpesinject->carry = g_byte_array_new ();
+  adpesinject->original = g_byte_array_new ();
+  gst_segment_init (&adpesinject->ad_segment, GST_FORMAT_TIME);
+  gst_adpesinject_reset_descriptors (adpesinject);
+  gst_adpesinject_reset_stream (adpesinject);
+
+  adpesinject->srcpad =
+      gst_pad_new_from_static_template (&gst_adpesinject_src_template, "src");
+  gst_pad_set_iterate_internal_links_function (adpesinject->srcpad,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_iterate_internal_links));
+  GST_PAD_SET_PROXY_CAPS (adpesinject->srcpad);
+
+  adpesinject->sinkpad =
+      gst_pad_new_from_static_template (&gst_adpesinject_sink_template, "sink");
+  gst_pad_set_chain_function (adpesinject->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_chain));
+  gst_pad_set_event_function (adpesinject->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_sink_event));
+  gst_pad_set_iterate_internal_links_function (adpesinject->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_iterate_internal_links));
+  GST_PAD_SET_PROXY_CAPS (adpesinject->sinkpad);
+
+  adpesinject->ad_sink =
+      gst_pad_new_from_static_template (&gst_adpesinject_ad_sink_template, "ad_sink");
+  gst_pad_set_chain_function (adpesinject->ad_sink,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_ad_chain));
+  gst_pad_set_event_function (adpesinject->ad_sink,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_ad_event));
+  gst_pad_set_iterate_internal_links_function (adpesinject->ad_sink,
+      GST_DEBUG_FUNCPTR (gst_adpesinject_iterate_internal_links));
+  gst_pad_use_fixed_caps (adpesinject->ad_sink);
+
+  gst_element_add_pad (GST_ELEMENT (adpesinject), adpesinject->srcpad);
+  gst_element_add_pad (GST_ELEMENT (adpesinject), adpesinject->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (adpesinject), adpesinject->ad_sink);
+}
+
+void
+gst_adpesinject_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAdpesinject *adpesinject = GST_ADPESINJECT (object);
+
+  GST_DEBUG_OBJECT (adpesinject, "set_property");
+
+  switch (property_id) {
+    case PROP_PID:
+      GST_OBJECT_LOCK (adpesinject);
+      adpesinject->pid = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (adpesinject);
+      break;
+    case PROP_PTS_OFFSET:
+      GST_OBJECT_LOCK (adpesinject);
+      adpesinject->pts_offset = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (adpesinject);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_adpesinject_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAdpesinject *adpesinject = GST_ADPESINJECT (object);
+
+  GST_DEBUG_OBJECT (adpesinject, "get_property");
+
+  switch (property_id) {
+    case PROP_PID:
+      GST_OBJECT_LOCK (adpesinject);
+      g_value_set_int (value, adpesinject->pid);
+      GST_OBJECT_UNLOCK (adpesinject);
+      break;
+    case PROP_PTS_OFFSET:
+      GST_OBJECT_LOCK (adpesinject);
+      g_value_set_uint64 (value, adpesinject->pts_offset);
+      GST_OBJECT_UNLOCK (adpesinject);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_adpesinject_dispose (GObject * object)
+{
+  GstAdpesinject *adpesinject = GST_ADPESINJECT (object);
+
+  GST_DEBUG_OBJECT (adpesinject, "dispose");
+
+  if (adpesinject->adapter) {
+    g_object_unref (adpesinject->adapter);
+    adpesinject->adapter = NULL;
+  }
+
+  G_OBJECT_CLASS (gst_adpesinject_parent_class)->dispose (object);
+}
+
+void
+gst_adpesinject_finalize (GObject * object)
+{
+  GstAdpesinject *adpesinject = GST_ADPESINJECT (object);
+
+  GST_DEBUG_OBJECT (adpesinject, "finalize");
+
+  g_byte_array_unref (adpesinject->out);
+  g_byte_array_unref (adpesinject->carry);
+  g_byte_array_unref (adpesinject->original);
+
+  G_OBJECT_CLASS (gst_adpesinject_parent_class)->finalize (object);
+}
+
+/* sink and src are linked to each other, and ad_sink to nothing */
+static GstIterator *
+gst_adpesinject_iterate_internal_links (GstPad * pad, GstObject * parent)
+{
+  GstAdpesinject *inject = GST_ADPESINJECT (parent);
+  GstPad *other;
+
+  if (pad == inject->sinkpad) {
+    other = inject->srcpad;
+  } else if (pad == inject->srcpad) {
+    other = inject->sinkpad;
+  } else {
+    return NULL;
+  }
+
+  GValue val = G_VALUE_INIT;
+  g_value_init (&val, GST_TYPE_PAD);
+  g_value_set_object (&val, other);
+  GstIterator *it = gst_iterator_new_single (GST_TYPE_PAD, &val);
+  g_value_unset (&val);
+  return it;
+}
+
+static GstFlowReturn
+gst_adpesinject_ad_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstAdpesinject *inject = GST_ADPESINJECT (parent);
+
+  GstClockTime running_time = gst_segment_to_running_time (&inject->ad_segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time)) {
+    GST_DEBUG_OBJECT (inject, "audio descriptor outside segment");
+    gst_buffer_unref (buffer);
+    return GST_FLOW_OK;
+  }
+  guint8 descriptor[AD_PES_PRIVATE_DATA_SIZE];
+  gsize size = gst_buffer_extract (buffer, 0, descriptor, sizeof (descriptor));
+  gst_buffer_unref (buffer);
+  if (size < 9) {
+    GST_DEBUG_OBJECT (inject, "audio descriptor too short");
+    return GST_FLOW_ERROR;
+  }
+
+  GST_OBJECT_LOCK (inject);
+  if (inject->pending_count == GST_ADPESINJECT_MAX_PENDING) {
+    // the audio has fallen a long way behind; the oldest pending
+    // descriptor would be superseded by the next in any case,
+    inject->current = inject->pending[inject->pending_head];
+    inject->have_current = TRUE;
+    inject->pending_head = (inject->pending_head + 1) % GST_ADPESINJECT_MAX_PENDING;
+    inject->pending_count--;
+  }
+  guint tail = (inject->pending_head + inject->pending_count) % GST_ADPESINJECT_MAX_PENDING;
+  struct _GstAdpesinjectDescriptor *desc = &inject->pending[tail];
+  desc->running_time = running_time;
+  // only the descriptor itself (as given by its length field) is kept; any
+  // trailing bytes, such as the CRC added by WHP 198, are replaced by the
+  // reserved value 0xff,
+  gsize length = MIN (1 + (descriptor[0] & 0x0f), size);
+  memset (desc->data, 0xff, sizeof (desc->data));
+  memcpy (desc->data, descriptor, length);
+  inject->pending_count++;
+  GST_OBJECT_UNLOCK (inject);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_adpesinject_ad_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstAdpesinject *inject = GST_ADPESINJECT (parent);
+
+  // descriptors are consumed here, so none of their events go any further
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &inject->ad_segment);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&inject->ad_segment, GST_FORMAT_TIME);
+      GST_OBJECT_LOCK (inject);
+      gst_adpesinject_reset_descriptors (inject);
+      GST_OBJECT_UNLOCK (inject);
+      break;
+    default:
+      break;
+  }
+  gst_event_unref (event);
+  return TRUE;
+}
+
+/* Returns the length of the adaptation field of the given packet without
+ * its trailing stuffing (including the adaptation_field_length byte), or 0
+ * if it has none, or none worth keeping. */
+static gsize
+adaptation_field_size (const guint8 *packet)
+{
+  if (!(packet[3] & 0x20) || packet[4] == 0) {
+    return 0;
+  }
+  const gsize length = MIN (packet[4], TS_PAYLOAD_SIZE - 1);
+  const guint8 flags = packet[5];
+  if (flags == 0) {
+    // stuffing only,
+    return 0;
+  }
+  const guint8 *p = packet + 6;
+  const guint8 *end = packet + 5 + length;
+  if (flags & 0x10) p += 6;  // PCR
+  if (flags & 0x08) p += 6;  // OPCR
+  if (flags & 0x04) p += 1;  // splice_countdown
+  if ((flags & 0x02) && p < end) p += 1 + *p;  // transport_private_data
+  if ((flags & 0x01) && p < end) p += 1 + *p;  // adaptation_field_extension
+  if (p > end) {
+    // malformed; keep it whole,
+    return 1 + length;
+  }
+  return p - (packet + 4);
+}
+
+/* Renumber the continuity_counter of a packet of the rewritten PID, given
+ * the counter for the next packet (and whether it is known yet). */
+static void
+renumber_cc (guint8 *packet, gboolean has_payload, guint8 *next_cc,
+    gboolean *have_cc)
+{
+  if (!*have_cc) {
+    *next_cc = packet[3] & 0x0f;
+    if (!has_payload) {
+      *next_cc = (*next_cc + 1) & 0x0f;
+    }
+    *have_cc = TRUE;
+  }
+  // the counter only advances for packets with payload,
+  guint8 cc = (*next_cc - 1) & 0x0f;
+  if (has_payload) {
+    cc = *next_cc;
+    *next_cc = (*next_cc + 1) & 0x0f;
+  }
+  packet[3] = (packet[3] & 0xf0) | cc;
+}
+
+static void
+gst_adpesinject_set_cc (GstAdpesinject *inject, guint8 *packet,
+    gboolean has_payload)
+{
+  renumber_cc (packet, has_payload, &inject->next_cc, &inject->have_cc);
+}
+
+/* Output a packet with the header (and adaptation field) of the given one,
+ * and as much of the rewritten PES packet as will fit, stuffing the
+ * adaptation field if that is less than the payload size. */
+static void
+gst_adpesinject_write_packet (GstAdpesinject *inject, const guint8 *packet)
+{
+  guint8 out[AD_PES_TS_PACKET_SIZE];
+  const gsize af_size = adaptation_field_size (packet);
+  const gsize capacity = TS_PAYLOAD_SIZE - af_size;
+  const gsize n = MIN (capacity, inject->carry->len);
+  const gsize stuffing = capacity - n;
+
+  memcpy (out, packet, 4);
+  gsize pos = 4;
+  if (af_size > 0) {
+    memcpy (out + pos, packet + 4, af_size);
+    out[pos] = af_size - 1 + stuffing;
+    pos += af_size;
+    memset (out + pos, 0xff, stuffing);
+    pos += stuffing;
+  } else if (stuffing > 0) {
+    out[pos++] = stuffing - 1;
+    if (stuffing > 1) {
+      out[pos++] = 0x00;
+      memset (out + pos, 0xff, stuffing - 2);
+      pos += stuffing - 2;
+    }
+  }
+  memcpy (out + pos, inject->carry->data, n);
+  g_byte_array_remove_range (inject->carry, 0, n);
+
+  const int adaptation_field_control = (af_size > 0 || stuffing > 0 ? 0x2 : 0)
+      | (n > 0 ? 0x1 : 0);
+  out[3] = (out[3] & 0xcf) | (adaptation_field_control << 4);
+  gst_adpesinject_set_cc (inject, out, n > 0);
+  g_byte_array_append (inject->out, out, sizeof (out));
+}
+
+/* Output the remainder of the PES packet being rewritten, in extra packets
+ * following those which originally carried it, or in a constant bitrate
+ * stream, put the original packets back should there be any remainder. */
+static void
+gst_adpesinject_finish_pes (GstAdpesinject *inject)
+{
+  if (!inject->rewriting) {
+    return;
+  }
+  if (inject->tentative) {
+    inject->tentative = FALSE;
+    if (inject->carry->len > 0) {
+      GST_DEBUG_OBJECT (inject, "no room in stuffing for descriptor; "
+          "leaving PES packet as it was");
+      g_byte_array_set_size (inject->out, inject->tentative_start);
+      g_byte_array_append (inject->out, inject->original->data,
+          inject->original->len);
+      inject->next_cc = inject->original_cc;
+      inject->have_cc = inject->original_have_cc;
+      g_byte_array_set_size (inject->carry, 0);
+    }
+    g_byte_array_set_size (inject->original, 0);
+  }
+  guint extra = 0;
+  while (inject->carry->len > 0) {
+    guint8 packet[AD_PES_TS_PACKET_SIZE];
+    memcpy (packet, inject->last_header, 4);
+    // a continuation, with payload only,
+    packet[1] &= ~0x40;
+    packet[3] = (packet[3] & 0xcf) | 0x10;
+    gst_adpesinject_write_packet (inject, packet);
+    extra++;
+  }
+  if (extra > 0) {
+    GST_LOG_OBJECT (inject, "added %u transport packets", extra);
+  }
+  inject->rewriting = FALSE;
+}
+
+/* Begin rewriting the PES packet whose header starts the payload of the
+ * given transport packet, if there is a descriptor to write into it.
+ * 'running_time' is that of the buffer holding the packet, from which the
+ * PTS offset is found unless 'pts_offset' is given. */
+static void
+gst_adpesinject_start_pes (GstAdpesinject *inject, const guint8 *packet,
+    gsize offset, GstClockTime pts_offset, GstClockTime running_time)
+{
+  const guint8 *pes = packet + offset;
+  const gsize size = AD_PES_TS_PACKET_SIZE - offset;
+
+  AdPesHeader header;
+  if (!ad_pes_parse_header (pes, size, &header) || header.pts == G_MAXUINT64) {
+    GST_LOG_OBJECT (inject, "no usable PES header");
+    return;
+  }
+  GstClockTime pts = gst_util_uint64_scale (
+      ad_pes_unwrap_pts (&inject->last_pts, header.pts), GST_SECOND, 90000);
+  if (!GST_CLOCK_TIME_IS_VALID (pts_offset)) {
+    if (!GST_CLOCK_TIME_IS_VALID (inject->stream_pts_offset)) {
+      if (!GST_CLOCK_TIME_IS_VALID (running_time) || pts < running_time) {
+        GST_DEBUG_OBJECT (inject, "no running time to match PTS %"
+            GST_TIME_FORMAT " against", GST_TIME_ARGS (pts));
+        return;
+      }
+      inject->stream_pts_offset = pts - running_time;
+      GST_INFO_OBJECT (inject, "PTS offset %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (inject->stream_pts_offset));
+    }
+    pts_offset = inject->stream_pts_offset;
+  }
+  if (pts < pts_offset) {
+    GST_DEBUG_OBJECT (inject, "PTS %" GST_TIME_FORMAT " precedes pts-offset",
+        GST_TIME_ARGS (pts));
+    return;
+  }
+  running_time = pts - pts_offset;
+
+  struct _GstAdpesinjectDescriptor current;
+  gboolean have_current;
+
+  GST_OBJECT_LOCK (inject);
+  while (inject->pending_count > 0
+      && inject->pending[inject->pending_head].running_time <= running_time) {
+    inject->current = inject->pending[inject->pending_head];
+    inject->have_current = TRUE;
+    inject->pending_head = (inject->pending_head + 1) % GST_ADPESINJECT_MAX_PENDING;
+    inject->pending_count--;
+  }
+  current = inject->current;
+  have_current = inject->have_current;
+  GST_OBJECT_UNLOCK (inject);
+
+  if (!have_current) {
+    return;
+  }
+
+  // PES_private_data is the first of the PES_extension fields, so follows
+  // directly on from the flags, which are themselves added if need be,
+  const gsize pes_packet_length = GST_READ_UINT16_BE (pes + 4);
+  gsize growth = 0;
+  if (header.private_data == 0) {
+    growth = AD_PES_PRIVATE_DATA_SIZE + (header.has_extension ? 0 : 1);
+  }
+  if (pes[8] + growth > 0xff
+      || (pes_packet_length != 0 && pes_packet_length + growth > 0xffff)) {
+    GST_DEBUG_OBJECT (inject, "no room in PES header for descriptor");
+    return;
+  }
+
+  g_byte_array_set_size (inject->carry, 0);
+  if (header.private_data != 0) {
+    g_byte_array_append (inject->carry, pes, size);
+    memcpy (inject->carry->data + header.private_data, current.data,
+        sizeof (current.data));
+  } else {
+    g_byte_array_append (inject->carry, pes, header.extension);
+    gsize rest = header.extension;
+    guint8 extension_flags;
+    if (header.has_extension) {
+      extension_flags = pes[rest++] | 0x80;
+    } else {
+      // PES_private_data_flag, and the reserved bits,
+      extension_flags = 0x8e;
+      inject->carry->data[7] |= 0x01;
+    }
+    g_byte_array_append (inject->carry, &extension_flags, 1);
+    g_byte_array_append (inject->carry, current.data, sizeof (current.data));
+    g_byte_array_append (inject->carry, pes + rest, size - rest);
+    inject->carry->data[8] += growth;
+    if (pes_packet_length != 0) {
+      GST_WRITE_UINT16_BE (inject->carry->data + 4, pes_packet_length + growth);
+    }
+  }
+  inject->pes_remaining = -1;
+  if (pes_packet_length != 0) {
+    inject->pes_remaining = MAX ((gssize) (6 + pes_packet_length - size), 0);
+  }
+  inject->rewriting = TRUE;
+  // in a constant bitrate stream, the original packets are kept until it's
+  // known whether the stuffing had room for the descriptor,
+  if (inject->cbr && growth > 0) {
+    inject->tentative = TRUE;
+    inject->tentative_start = inject->out->len;
+    inject->original_cc = inject->next_cc;
+    inject->original_have_cc = inject->have_cc;
+    g_byte_array_set_size (inject->original, 0);
+  }
+  GST_LOG_OBJECT (inject, "descriptor fade=%x at %" GST_TIME_FORMAT,
+      current.data[7], GST_TIME_ARGS (running_time));
+}
+
+static void
+gst_adpesinject_process_packet (GstAdpesinject *inject, const guint8 *packet,
+    GstClockTime pts_offset, GstClockTime running_time)
+{
+  const gboolean payload_unit_start = packet[1] & 0x40;
+  const gsize offset = ad_pes_payload_offset (packet);
+
+  if (payload_unit_start && offset != 0) {
+    gst_adpesinject_finish_pes (inject);
+    gst_adpesinject_start_pes (inject, packet, offset, pts_offset,
+        running_time);
+  } else if (inject->rewriting && offset != 0) {
+    const gsize size = AD_PES_TS_PACKET_SIZE - offset;
+    g_byte_array_append (inject->carry, packet + offset, size);
+    if (inject->pes_remaining > 0) {
+      inject->pes_remaining = MAX (inject->pes_remaining - (gssize) size, 0);
+    }
+  }
+  if (inject->tentative) {
+    g_byte_array_append (inject->original, packet, AD_PES_TS_PACKET_SIZE);
+    renumber_cc (inject->original->data + inject->original->len
+        - AD_PES_TS_PACKET_SIZE, offset != 0, &inject->original_cc,
+        &inject->original_have_cc);
+  }
+  memcpy (inject->last_header, packet, 4);
+
+  if (inject->rewriting) {
+    gst_adpesinject_write_packet (inject, packet);
+    if (inject->pes_remaining == 0) {
+      gst_adpesinject_finish_pes (inject);
+    }
+  } else {
+    g_byte_array_append (inject->out, packet, AD_PES_TS_PACKET_SIZE);
+    gst_adpesinject_set_cc (inject,
+        inject->out->data + inject->out->len - AD_PES_TS_PACKET_SIZE,
+        offset != 0);
+  }
+}
+
+/* Push the packets output so far, with the timestamps and flags of the
+ * given buffer (if any), holding back any which may yet be replaced by the
+ * originals. */
+static GstFlowReturn
+gst_adpesinject_push_out (GstAdpesinject *inject, GstBuffer *buffer)
+{
+  const gsize len = inject->tentative ? inject->tentative_start
+      : inject->out->len;
+  if (len == 0) {
+    if (buffer) {
+      gst_buffer_unref (buffer);
+    }
+    return GST_FLOW_OK;
+  }
+  GstBuffer *outbuf = gst_buffer_new_allocate (NULL, len, NULL);
+  gst_buffer_fill (outbuf, 0, inject->out->data, len);
+  g_byte_array_remove_range (inject->out, 0, len);
+  inject->tentative_start = 0;
+  if (buffer) {
+    gst_buffer_copy_into (outbuf, buffer,
+        GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    gst_buffer_unref (buffer);
+  }
+  return gst_pad_push (inject->srcpad, outbuf);
+}
+
+static GstFlowReturn
+gst_adpesinject_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstAdpesinject *inject = GST_ADPESINJECT (parent);
+
+  GST_OBJECT_LOCK (inject);
+  const gint pid = inject->pid;
+  const GstClockTime pts_offset = inject->pts_offset;
+  GST_OBJECT_UNLOCK (inject);
+
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
+  if (inject->segment.format == GST_FORMAT_TIME) {
+    running_time = gst_segment_to_running_time (&inject->segment,
+        GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  }
+
+  if (pid == -1 && !inject->have_cc
+      && gst_adapter_available (inject->adapter) == 0) {
+    return gst_pad_push (inject->srcpad, buffer);
+  }
+
+  gst_adapter_push (inject->adapter, gst_buffer_ref (buffer));
+  while (gst_adapter_available (inject->adapter) >= AD_PES_TS_PACKET_SIZE) {
+    const guint8 *packet = gst_adapter_map (inject->adapter, AD_PES_TS_PACKET_SIZE);
+    if (packet[0] != AD_PES_TS_SYNC_BYTE) {
+      // lost packet alignment; pass bytes through until the next sync byte
+      g_byte_array_append (inject->out, packet, 1);
+      if (inject->tentative) {
+        g_byte_array_append (inject->original, packet, 1);
+      }
+      gst_adapter_unmap (inject->adapter);
+      gst_adapter_flush (inject->adapter, 1);
+      continue;
+    }
+    const gint packet_pid = ((packet[1] & 0x1f) << 8) | packet[2];
+    if (packet_pid == NULL_PID && !inject->cbr) {
+      GST_INFO_OBJECT (inject, "null packets found; no packets will be added");
+      inject->cbr = TRUE;
+    }
+    if (packet_pid == pid) {
+      gst_adpesinject_process_packet (inject, packet, pts_offset,
+          running_time);
+    } else {
+      g_byte_array_append (inject->out, packet, AD_PES_TS_PACKET_SIZE);
+      if (inject->tentative) {
+        g_byte_array_append (inject->original, packet, AD_PES_TS_PACKET_SIZE);
+      }
+    }
+    gst_adapter_unmap (inject->adapter);
+    gst_adapter_flush (inject->adapter, AD_PES_TS_PACKET_SIZE);
+  }
+  return gst_adpesinject_push_out (inject, buffer);
+}
+
+static gboolean
+gst_adpesinject_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstAdpesinject *inject = GST_ADPESINJECT (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      // complete any PES packet of unbounded length,
+      gst_adpesinject_finish_pes (inject);
+      gst_adpesinject_push_out (inject, NULL);
+      break;
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &inject->segment);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_adpesinject_reset_stream (inject);
+      break;
+    default:
+      break;
+  }
+  return gst_pad_event_default (pad, parent, event);
+}
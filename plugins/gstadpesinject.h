@@ -0,0 +1,121 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ADPESINJECT_H_
+#define _GST_ADPESINJECT_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+#include "gstadpes.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ADPESINJECT   (gst_adpesinject_get_type())
+#define GST_ADPESINJECT(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ADPESINJECT,GstAdpesinject))
+#define GST_ADPESINJECT_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ADPESINJECT,GstAdpesinjectClass))
+#define GST_IS_ADPESINJECT(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ADPESINJECT))
+#define GST_IS_ADPESINJECT_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ADPESINJECT))
+
+#define GST_ADPESINJECT_MAX_PENDING 32
+
+typedef struct _GstAdpesinject GstAdpesinject;
+typedef struct _GstAdpesinjectClass GstAdpesinjectClass;
+
+struct _GstAdpesinjectDescriptor {
+  GstClockTime running_time;
+  // formatted as PES_private_data,
+  guint8 data[AD_PES_PRIVATE_DATA_SIZE];
+};
+
+struct _GstAdpesinject
+{
+  GstElement base_adpesinject;
+
+  GstPad *sinkpad, *srcpad, *ad_sink;
+
+  GstSegment ad_segment;
+  // of the transport stream, giving the running time of its buffers,
+  GstSegment segment;
+
+  // PID of the description audio, or -1 to leave the stream untouched,
+  // and the difference between its PTS and the running time of the
+  // descriptors, or GST_CLOCK_TIME_NONE to find it from the stream,
+  // (protected by the object lock)
+  gint pid;
+  GstClockTime pts_offset;
+
+  // descriptors received but not yet reached by the audio, oldest first,
+  // (protected by the object lock)
+  struct _GstAdpesinjectDescriptor pending[GST_ADPESINJECT_MAX_PENDING];
+  guint pending_head;
+  guint pending_count;
+
+  // the descriptor written into PES headers at present,
+  struct _GstAdpesinjectDescriptor current;
+  gboolean have_current;
+
+  // holds incoming data until a whole transport packet is available,
+  GstAdapter *adapter;
+  // transport packets ready to be pushed,
+  GByteArray *out;
+
+  // The PES packet being rewritten, which is now longer than the transport
+  // packets which carried it; the bytes not yet output, and the count of
+  // bytes of the original still to arrive (or -1 if it is of unbounded
+  // length),
+  GByteArray *carry;
+  gboolean rewriting;
+  gssize pes_remaining;
+  // the header of the last packet of the PID, to start any extra packets,
+  guint8 last_header[4];
+  // continuity_counter for the next packet of the PID, which is renumbered
+  // to account for extra packets,
+  guint8 next_cc;
+  gboolean have_cc;
+
+  // most recent PTS, extended beyond 33 bits to survive wraparound,
+  guint64 last_pts;
+  // the PTS offset found from the first PES packet, if "pts-offset" isn't
+  // set,
+  GstClockTime stream_pts_offset;
+
+  // Whether null packets have been seen, and so the muxer is taken to run
+  // at a constant bitrate, where no packets may be added.  While the PES
+  // packet being rewritten might yet turn out to need more room than its
+  // stuffing has, the output from 'tentative_start' on is held back, and
+  // the same packets as they were kept in 'original', with their own
+  // continuity_counter,
+  gboolean cbr;
+  gboolean tentative;
+  gsize tentative_start;
+  GByteArray *original;
+  guint8 original_cc;
+  gboolean original_have_cc;
+};
+
+struct _GstAdpesinjectClass
+{
+  GstElementClass base_adpesinject_class;
+};
+
+GType gst_adpesinject_get_type (void);
+
+G_END_DECLS
+
+#endif
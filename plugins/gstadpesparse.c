@@ -0,0 +1,389 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstadpesparse
+ *
+ * The adpesparse element extracts the Audio Description descriptors which
+ * broadcast transport streams carry in the PES_private_data of the PES
+ * headers of the description audio (per "ETSI TS 101 154"), producing the
+ * same descriptor buffers as whp198dec without any need to decode the
+ * audio itself.
+ *
+ * Output timestamps are taken from the PTS of the PES packet carrying each
+ * descriptor.  So that running time lines up with the audio coming out of
+ * tsdemux, the output segment starts where tsdemux's would: at the lowest of
+ * the first PTS seen on each PID, taken over the PES packets which arrive
+ * before the first descriptor (a stream whose first PES packet only arrives
+ * later can't move the origin).  A new segment, and a new origin, follow
+ * every upstream segment or flush.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=test.ts ! adpesparse ! fakesink dump=true
+ * ]|
+ * Dump the descriptors carried on the first PID found to have any
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include "gstadpesparse.h"
+#include "gstadpes.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_adpesparse_debug_category);
+#define GST_CAT_DEFAULT gst_adpesparse_debug_category
+
+/* prototypes */
+
+
+static void gst_adpesparse_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_adpesparse_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_adpesparse_dispose (GObject * object);
+static void gst_adpesparse_finalize (GObject * object);
+
+static GstFlowReturn gst_adpesparse_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer);
+static gboolean gst_adpesparse_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+
+enum
+{
+  PROP_0,
+  PROP_PID
+};
+
+#define DEFAULT_PID -1
+
+
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_adpesparse_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-tr_101_154_ad_descriptor")
+    );
+
+static GstStaticPadTemplate gst_adpesparse_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/mpegts, systemstream = (boolean) true")
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstAdpesparse, gst_adpesparse, GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (gst_adpesparse_debug_category, "adpesparse", 0,
+        "debug category for adpesparse element"));
+
+static void
+gst_adpesparse_class_init (GstAdpesparseClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_adpesparse_src_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_adpesparse_sink_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "MPEG-TS Audio Description descriptor parser",
+      "Codec/Parser",
+      "Extracts Audio Description descriptors from the PES private data of an MPEG transport stream",
+      "David Holroyd <dave@badgers-in-foil.co.uk>");
+
+  gobject_class->set_property = gst_adpesparse_set_property;
+  gobject_class->get_property = gst_adpesparse_get_property;
+  gobject_class->dispose = gst_adpesparse_dispose;
+  gobject_class->finalize = gst_adpesparse_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_PID,
+      g_param_spec_int ("pid", "PID",
+          "PID of the description audio, or -1 to use the first PID found to carry descriptors",
+          -1, 0x1fff, DEFAULT_PID,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_adpesparse_reset (GstAdpesparse *parse)
+{
+  gst_adapter_clear (parse->adapter);
+  parse->locked_pid = parse->pid;
+  parse->last_pts = G_MAXUINT64;
+  parse->need_segment = TRUE;
+  parse->origin = G_MAXUINT64;
+  memset (parse->pts_seen, 0, sizeof (parse->pts_seen));
+}
+
+static void
+gst_adpesparse_init (GstAdpesparse * adpesparse)
+{
+  adpesparse->pid = DEFAULT_PID;
+  adpesparse->adapter = gst_adapter_new ();
+  gst_adpesparse_reset (adpesparse);
+
+  adpesparse->srcpad =
+      gst_pad_new_from_static_template (&gst_adpesparse_src_template, "src");
+  adpesparse->sinkpad =
+      gst_pad_new_from_static_template (&gst_adpesparse_sink_template, "sink");
+
+  gst_pad_set_chain_function (adpesparse->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_adpesparse_chain));
+  gst_pad_set_event_function (adpesparse->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_adpesparse_sink_event));
+  gst_pad_use_fixed_caps (adpesparse->srcpad);
+
+  gst_element_add_pad (GST_ELEMENT (adpesparse), adpesparse->srcpad);
+  gst_element_add_pad (GST_ELEMENT (adpesparse), adpesparse->sinkpad);
+}
+
+void
+gst_adpesparse_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAdpesparse *adpesparse = GST_ADPESPARSE (object);
+
+  GST_DEBUG_OBJECT (adpesparse, "set_property");
+
+  switch (property_id) {
+    case PROP_PID:
+      GST_OBJECT_LOCK (adpesparse);
+      adpesparse->pid = g_value_get_int (value);
+      adpesparse->locked_pid = adpesparse->pid;
+      GST_OBJECT_UNLOCK (adpesparse);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_adpesparse_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAdpesparse *adpesparse = GST_ADPESPARSE (object);
+
+  GST_DEBUG_OBJECT (adpesparse, "get_property");
+
+  switch (property_id) {
+    case PROP_PID:
+      GST_OBJECT_LOCK (adpesparse);
+      g_value_set_int (value, adpesparse->pid);
+      GST_OBJECT_UNLOCK (adpesparse);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_adpesparse_dispose (GObject * object)
+{
+  GstAdpesparse *adpesparse = GST_ADPESPARSE (object);
+
+  GST_DEBUG_OBJECT (adpesparse, "dispose");
+
+  if (adpesparse->adapter) {
+    g_object_unref (adpesparse->adapter);
+    adpesparse->adapter = NULL;
+  }
+
+  G_OBJECT_CLASS (gst_adpesparse_parent_class)->dispose (object);
+}
+
+void
+gst_adpesparse_finalize (GObject * object)
+{
+  GstAdpesparse *adpesparse = GST_ADPESPARSE (object);
+
+  GST_DEBUG_OBJECT (adpesparse, "finalize");
+
+  /* clean up object here */
+
+  G_OBJECT_CLASS (gst_adpesparse_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_adpesparse_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstAdpesparse *parse = GST_ADPESPARSE (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS: {
+      // replace the transport stream caps with our own,
+      gst_event_unref (event);
+      GstCaps *caps = gst_static_pad_template_get_caps (&gst_adpesparse_src_template);
+      gboolean res = gst_pad_push_event (parse->srcpad, gst_event_new_caps (caps));
+      gst_caps_unref (caps);
+      return res;
+    }
+    case GST_EVENT_SEGMENT:
+      // upstream is usually in BYTES format; a TIME segment is sent once
+      // the origin is known, and (as after a seek) the origin must be found
+      // afresh,
+      parse->need_segment = TRUE;
+      parse->origin = G_MAXUINT64;
+      memset (parse->pts_seen, 0, sizeof (parse->pts_seen));
+      gst_event_unref (event);
+      return TRUE;
+    case GST_EVENT_FLUSH_STOP:
+      GST_OBJECT_LOCK (parse);
+      gst_adpesparse_reset (parse);
+      GST_OBJECT_UNLOCK (parse);
+      break;
+    default:
+      break;
+  }
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static GstFlowReturn
+gst_adpesparse_push_descriptor (GstAdpesparse *parse,
+    const guint8 *private_data, guint64 pts)
+{
+  GstClockTime ts = GST_CLOCK_TIME_NONE;
+  if (pts != G_MAXUINT64) {
+    ts = gst_util_uint64_scale (ad_pes_unwrap_pts (&parse->last_pts, pts),
+        GST_SECOND, 90000);
+  }
+
+  if (parse->need_segment) {
+    if (!GST_CLOCK_TIME_IS_VALID (ts)) {
+      GST_DEBUG_OBJECT (parse, "no PTS yet; dropping descriptor");
+      return GST_FLOW_OK;
+    }
+    // the descriptor's own PTS took part in finding the origin, so it can be
+    // no earlier,
+    const GstClockTime origin =
+        gst_util_uint64_scale (parse->origin, GST_SECOND, 90000);
+    GST_DEBUG_OBJECT (parse, "segment origin %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (origin));
+    GstSegment segment;
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    segment.start = origin;
+    segment.time = origin;
+    segment.position = origin;
+    gst_pad_push_event (parse->srcpad, gst_event_new_segment (&segment));
+    parse->need_segment = FALSE;
+  }
+
+  GstBuffer *buf = gst_buffer_new_and_alloc (AD_PES_PRIVATE_DATA_SIZE);
+  gst_buffer_fill (buf, 0, private_data, AD_PES_PRIVATE_DATA_SIZE);
+  GST_BUFFER_PTS (buf) = ts;
+  GST_LOG_OBJECT (parse, "descriptor fade=%x ts=%" GST_TIME_FORMAT,
+      private_data[7], GST_TIME_ARGS (ts));
+  return gst_pad_push (parse->srcpad, buf);
+}
+
+/* 'locked_pid' is the chain function's copy of the PID that descriptors are
+ * taken from (or -1), updated here should the PID be found. */
+static GstFlowReturn
+gst_adpesparse_process_packet (GstAdpesparse *parse, const guint8 *packet,
+    gint *locked_pid)
+{
+  const gboolean payload_unit_start = packet[1] & 0x40;
+  const gint pid = ((packet[1] & 0x1f) << 8) | packet[2];
+
+  // PES headers only ever start at the beginning of a packet payload,
+  if (!payload_unit_start) {
+    return GST_FLOW_OK;
+  }
+  const gboolean wanted = *locked_pid == -1 || pid == *locked_pid;
+  // until the segment goes out, the first PTS on every PID counts towards
+  // the origin,
+  const gboolean first_on_pid = parse->need_segment
+      && !(parse->pts_seen[pid / 8] & (1 << (pid % 8)));
+  if (!wanted && !first_on_pid) {
+    return GST_FLOW_OK;
+  }
+  const gsize offset = ad_pes_payload_offset (packet);
+  if (offset == 0) {
+    return GST_FLOW_OK;
+  }
+
+  AdPesHeader header;
+  if (!ad_pes_parse_header (packet + offset, AD_PES_TS_PACKET_SIZE - offset,
+          &header)) {
+    GST_LOG_OBJECT (parse, "no usable PES header on PID 0x%04x", pid);
+    return GST_FLOW_OK;
+  }
+  if (first_on_pid && header.pts != G_MAXUINT64) {
+    parse->pts_seen[pid / 8] |= 1 << (pid % 8);
+    parse->origin = MIN (parse->origin,
+        ad_pes_unwrap_pts (&parse->last_pts, header.pts));
+  }
+  if (!wanted || header.private_data == 0) {
+    return GST_FLOW_OK;
+  }
+  const guint8 *private_data = packet + offset + header.private_data;
+  if (!ad_pes_is_descriptor (private_data)) {
+    return GST_FLOW_OK;
+  }
+  if (*locked_pid == -1) {
+    GST_INFO_OBJECT (parse, "found descriptors on PID 0x%04x", pid);
+    *locked_pid = pid;
+    // unless the "pid" property was set meanwhile,
+    GST_OBJECT_LOCK (parse);
+    if (parse->locked_pid == -1) {
+      parse->locked_pid = pid;
+    }
+    GST_OBJECT_UNLOCK (parse);
+  }
+  return gst_adpesparse_push_descriptor (parse, private_data, header.pts);
+}
+
+static GstFlowReturn
+gst_adpesparse_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstAdpesparse *parse = GST_ADPESPARSE (parent);
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  // the "pid" property may change it at any time,
+  GST_OBJECT_LOCK (parse);
+  gint locked_pid = parse->locked_pid;
+  GST_OBJECT_UNLOCK (parse);
+
+  gst_adapter_push (parse->adapter, buffer);
+  while (ret == GST_FLOW_OK
+      && gst_adapter_available (parse->adapter) >= AD_PES_TS_PACKET_SIZE) {
+    const guint8 *packet = gst_adapter_map (parse->adapter, AD_PES_TS_PACKET_SIZE);
+    if (packet[0] != AD_PES_TS_SYNC_BYTE) {
+      // lost packet alignment; skip forward until the next sync byte
+      gst_adapter_unmap (parse->adapter);
+      gst_adapter_flush (parse->adapter, 1);
+      continue;
+    }
+    ret = gst_adpesparse_process_packet (parse, packet, &locked_pid);
+    gst_adapter_unmap (parse->adapter);
+    gst_adapter_flush (parse->adapter, AD_PES_TS_PACKET_SIZE);
+  }
+  return ret;
+}
@@ -0,0 +1,70 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ADPESPARSE_H_
+#define _GST_ADPESPARSE_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ADPESPARSE   (gst_adpesparse_get_type())
+#define GST_ADPESPARSE(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ADPESPARSE,GstAdpesparse))
+#define GST_ADPESPARSE_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ADPESPARSE,GstAdpesparseClass))
+#define GST_IS_ADPESPARSE(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ADPESPARSE))
+#define GST_IS_ADPESPARSE_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ADPESPARSE))
+
+typedef struct _GstAdpesparse GstAdpesparse;
+typedef struct _GstAdpesparseClass GstAdpesparseClass;
+
+struct _GstAdpesparse
+{
+  GstElement base_adpesparse;
+
+  GstPad *sinkpad, *srcpad;
+
+  // PID to take descriptors from, or -1 for the first PID found to carry
+  // them,
+  gint pid;
+  gint locked_pid;
+
+  // holds incoming data until a whole transport packet is available,
+  GstAdapter *adapter;
+
+  // most recent PTS, extended beyond 33 bits to survive wraparound,
+  guint64 last_pts;
+  gboolean need_segment;
+
+  // lowest (extended) first PTS of any PID, which becomes the segment start
+  // as it does in tsdemux, and the PIDs whose first PTS has been seen,
+  guint64 origin;
+  guint8 pts_seen[8192 / 8];
+};
+
+struct _GstAdpesparseClass
+{
+  GstElementClass base_adpesparse_class;
+};
+
+GType gst_adpesparse_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,260 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gstadshm.h"
+
+#define GST_AD_SHM_MAGIC 0x41445348     // "ADSH"
+#define GST_AD_SHM_VERSION 1
+// a power of two, so that the entry for an index survives its wrapping,
+#define GST_AD_SHM_CAPACITY 256
+
+// The layout of the segment, shared between processes, so of fixed-size
+// fields only,
+typedef struct
+{
+  volatile gint seq;
+  guint32 index;
+  guint64 clock_time;
+  guint32 size;
+  guint8 data[GST_AD_SHM_DESCRIPTOR_SIZE];
+} GstAdShmEntry;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 capacity;
+  // count of entries written (wrapping),
+  volatile gint write_index;
+  GstAdShmEntry entries[GST_AD_SHM_CAPACITY];
+} GstAdShmSegment;
+
+struct _GstAdShm
+{
+  GstAdShmSegment *segment;
+  gboolean writable;
+};
+
+/* POSIX requires shared-memory names to start with a single '/' */
+static gchar *
+shm_path (const gchar * name)
+{
+  return name[0] == '/' ? g_strdup (name) : g_strconcat ("/", name, NULL);
+}
+
+static GstAdShm *
+map_segment (const gchar * name, gboolean create, GError ** error)
+{
+  gchar *path = shm_path (name);
+  int fd = shm_open (path, create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (fd < 0) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "shm_open(%s) failed: %s", path, g_strerror (errno));
+    g_free (path);
+    return NULL;
+  }
+  struct stat st;
+  if ((create && ftruncate (fd, sizeof (GstAdShmSegment)) < 0)
+      || fstat (fd, &st) < 0 || st.st_size < (off_t) sizeof (GstAdShmSegment)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "shared memory %s is not a descriptor ring", path);
+    close (fd);
+    g_free (path);
+    return NULL;
+  }
+  void *addr = mmap (NULL, sizeof (GstAdShmSegment),
+      create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (addr == MAP_FAILED) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "mmap(%s) failed: %s", path, g_strerror (errno));
+    g_free (path);
+    return NULL;
+  }
+  g_free (path);
+
+  GstAdShm *shm = g_new0 (GstAdShm, 1);
+  shm->segment = addr;
+  shm->writable = create;
+  return shm;
+}
+
+/* Create the named segment, or take over an existing one (carrying on from
+ * its last entry, so that readers are not disturbed by a restart of the
+ * publisher). */
+GstAdShm *
+gst_ad_shm_create (const gchar * name, GError ** error)
+{
+  GstAdShm *shm = map_segment (name, TRUE, error);
+  if (shm == NULL) {
+    return NULL;
+  }
+  GstAdShmSegment *segment = shm->segment;
+  if (segment->magic != GST_AD_SHM_MAGIC || segment->version != GST_AD_SHM_VERSION
+      || segment->capacity != GST_AD_SHM_CAPACITY) {
+    memset (segment, 0, sizeof (*segment));
+    segment->version = GST_AD_SHM_VERSION;
+    segment->capacity = GST_AD_SHM_CAPACITY;
+    // readers check the magic last,
+    g_atomic_int_set ((volatile gint *) &segment->magic, GST_AD_SHM_MAGIC);
+  }
+  return shm;
+}
+
+/* Open the named segment for reading, failing if no publisher has yet
+ * created it */
+GstAdShm *
+gst_ad_shm_open (const gchar * name, GError ** error)
+{
+  GstAdShm *shm = map_segment (name, FALSE, error);
+  if (shm == NULL) {
+    return NULL;
+  }
+  GstAdShmSegment *segment = shm->segment;
+  if (g_atomic_int_get ((volatile gint *) &segment->magic) != GST_AD_SHM_MAGIC
+      || segment->version != GST_AD_SHM_VERSION
+      || segment->capacity != GST_AD_SHM_CAPACITY) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "shared memory %s is not a descriptor ring", name);
+    gst_ad_shm_close (shm);
+    return NULL;
+  }
+  return shm;
+}
+
+void
+gst_ad_shm_close (GstAdShm * shm)
+{
+  munmap (shm->segment, sizeof (GstAdShmSegment));
+  g_free (shm);
+}
+
+void
+gst_ad_shm_write (GstAdShm * shm, GstClockTime clock_time,
+    const guint8 * data, gsize size)
+{
+  GstAdShmSegment *segment = shm->segment;
+  g_return_if_fail (shm->writable);
+  g_return_if_fail (size <= GST_AD_SHM_DESCRIPTOR_SIZE);
+
+  guint32 index = (guint32) g_atomic_int_get (&segment->write_index);
+  GstAdShmEntry *entry = &segment->entries[index % GST_AD_SHM_CAPACITY];
+
+  // an odd sequence number marks the entry as being written, and the
+  // barrier keeps the writes below from being seen before it,
+  g_atomic_int_inc (&entry->seq);
+  __sync_synchronize ();
+  entry->index = index;
+  entry->clock_time = clock_time;
+  entry->size = size;
+  memcpy (entry->data, data, size);
+  g_atomic_int_inc (&entry->seq);
+
+  g_atomic_int_set (&segment->write_index, (gint) (index + 1));
+}
+
+/* The index that the next entry written will have */
+guint32
+gst_ad_shm_get_write_index (GstAdShm * shm)
+{
+  return (guint32) g_atomic_int_get (&shm->segment->write_index);
+}
+
+/* The index of the newest entry applying at or before 'clock_time' (or
+ * failing that, the oldest entry), from which a reader joining late starts
+ * so as to take up the fade already in effect.  Returns the write index if
+ * the ring is empty. */
+guint32
+gst_ad_shm_find (GstAdShm * shm, GstClockTime clock_time)
+{
+  GstAdShmSegment *segment = shm->segment;
+  const guint32 write_index = gst_ad_shm_get_write_index (shm);
+  guint32 start = write_index;
+
+  for (guint32 n = 1; n <= MIN (write_index, GST_AD_SHM_CAPACITY); n++) {
+    const guint32 index = write_index - n;
+    GstAdShmEntry *entry = &segment->entries[index % GST_AD_SHM_CAPACITY];
+    gint seq = g_atomic_int_get (&entry->seq);
+    guint32 entry_index = entry->index;
+    GstClockTime entry_time = entry->clock_time;
+    __sync_synchronize ();
+    if ((seq & 1) != 0 || g_atomic_int_get (&entry->seq) != seq
+        || entry_index != index) {
+      // overwritten by the publisher since, as is everything older,
+      break;
+    }
+    start = index;
+    if (entry_time <= clock_time) {
+      break;
+    }
+  }
+  return start;
+}
+
+/* Read the oldest entry not yet read, advancing '*index' (the reader's
+ * position, initially from gst_ad_shm_get_write_index() or
+ * gst_ad_shm_find()) past it.  Entries
+ * overwritten before the reader got to them are skipped.  Returns FALSE if
+ * there is nothing to read. */
+gboolean
+gst_ad_shm_read (GstAdShm * shm, guint32 * index, GstClockTime * clock_time,
+    guint8 * data, gsize * size)
+{
+  GstAdShmSegment *segment = shm->segment;
+
+  for (;;) {
+    guint32 write_index = gst_ad_shm_get_write_index (shm);
+    if (*index == write_index) {
+      return FALSE;
+    }
+    if (write_index - *index > GST_AD_SHM_CAPACITY) {
+      GST_WARNING ("descriptor ring overrun; skipping %u entries",
+          write_index - *index - GST_AD_SHM_CAPACITY);
+      *index = write_index - GST_AD_SHM_CAPACITY;
+    }
+
+    GstAdShmEntry *entry = &segment->entries[*index % GST_AD_SHM_CAPACITY];
+    gint seq = g_atomic_int_get (&entry->seq);
+    guint32 entry_index = entry->index;
+    *clock_time = entry->clock_time;
+    *size = MIN (entry->size, GST_AD_SHM_DESCRIPTOR_SIZE);
+    memcpy (data, entry->data, *size);
+    // keep the reads above from being seen after the check below,
+    __sync_synchronize ();
+    gboolean consistent = (seq & 1) == 0 && g_atomic_int_get (&entry->seq) == seq;
+
+    (*index)++;
+    if (consistent && entry_index == *index - 1) {
+      return TRUE;
+    }
+    // entries before the write index are complete, so one which is being
+    // written, or holds another index, has been overwritten since the
+    // write index was read; skip it,
+  }
+}
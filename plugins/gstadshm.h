@@ -0,0 +1,58 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_AD_SHM_H_
+#define _GST_AD_SHM_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* A ring of AD_descriptors in a named POSIX shared-memory segment, written
+ * by a single publisher (adshmsink) and read by any number of adcontrol
+ * instances in other processes.  Each descriptor is stamped with the clock
+ * time (running time plus base time) at which it applies, so that readers
+ * whose clocks share its time base (e.g. the monotonic system clock, on the
+ * same machine) can place it on their own running time.
+ *
+ * Neither side takes a lock; each entry is guarded by a sequence number
+ * which is odd while the entry is being written, and readers discard any
+ * entry which changed while being read. */
+
+// largest descriptor held in an entry (the PES_private_data size, which
+// the longest AD_descriptor fills),
+#define GST_AD_SHM_DESCRIPTOR_SIZE 16
+
+typedef struct _GstAdShm GstAdShm;
+
+GstAdShm *gst_ad_shm_create (const gchar * name, GError ** error);
+GstAdShm *gst_ad_shm_open (const gchar * name, GError ** error);
+void gst_ad_shm_close (GstAdShm * shm);
+
+void gst_ad_shm_write (GstAdShm * shm, GstClockTime clock_time,
+    const guint8 * data, gsize size);
+
+guint32 gst_ad_shm_get_write_index (GstAdShm * shm);
+guint32 gst_ad_shm_find (GstAdShm * shm, GstClockTime clock_time);
+gboolean gst_ad_shm_read (GstAdShm * shm, guint32 * index,
+    GstClockTime * clock_time, guint8 * data, gsize * size);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,268 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:element-gstadshmsink
+ *
+ * The adshmsink element publishes Audio Description descriptors into a
+ * named shared-memory segment, from which any number of adcontrol elements
+ * in other processes (given the same "shm-name") may take them.  One
+ * decoder can then drive the fading of many renditions.
+ *
+ * Each descriptor is stamped with the clock time at which it applies (its
+ * running time plus the pipeline's base time), so publisher and readers
+ * must use clocks with the same time base.  The system clock is monotonic
+ * time, so only serves on a single machine.  Between machines, network
+ * clocks slaved to one master are needed.
+ *
+ * Only the AD_descriptor itself, of the length given in its first byte, is
+ * published; trailing bytes (such as the CRC kept by whp198dec) are left
+ * out, and descriptors too short to hold a fade are dropped with a
+ * warning.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=test.wav ! wavparse ! deinterleave name=d d.src_1 ! audioconvert ! whp198dec ! adshmsink shm-name=/ad-feed-1
+ * ]|
+ * Publish the descriptors decoded from a WAV file for adcontrol elements
+ * with shm-name=/ad-feed-1
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include "gstadshmsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_adshmsink_debug_category);
+#define GST_CAT_DEFAULT gst_adshmsink_debug_category
+
+/* prototypes */
+
+
+static void gst_adshmsink_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_adshmsink_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_adshmsink_finalize (GObject * object);
+
+static gboolean gst_adshmsink_start (GstBaseSink * sink);
+static gboolean gst_adshmsink_stop (GstBaseSink * sink);
+static GstFlowReturn gst_adshmsink_render (GstBaseSink * sink,
+    GstBuffer * buffer);
+
+enum
+{
+  PROP_0,
+  PROP_SHM_NAME
+};
+
+#define DEFAULT_SHM_NAME "/audiodescription"
+
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_adshmsink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-tr_101_154_ad_descriptor")
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstAdshmsink, gst_adshmsink, GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (gst_adshmsink_debug_category, "adshmsink", 0,
+        "debug category for adshmsink element"));
+
+static void
+gst_adshmsink_class_init (GstAdshmsinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS (klass);
+
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_adshmsink_sink_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "Audio Description shared-memory publisher",
+      "Sink",
+      "Publishes Audio Description descriptors in shared memory for adcontrol elements in other processes",
+      "David Holroyd <dave@badgers-in-foil.co.uk>");
+
+  gobject_class->set_property = gst_adshmsink_set_property;
+  gobject_class->get_property = gst_adshmsink_get_property;
+  gobject_class->finalize = gst_adshmsink_finalize;
+  base_sink_class->start = GST_DEBUG_FUNCPTR (gst_adshmsink_start);
+  base_sink_class->stop = GST_DEBUG_FUNCPTR (gst_adshmsink_stop);
+  base_sink_class->render = GST_DEBUG_FUNCPTR (gst_adshmsink_render);
+
+  g_object_class_install_property (gobject_class, PROP_SHM_NAME,
+      g_param_spec_string ("shm-name", "Shared memory name",
+          "Name of the shared-memory segment to publish descriptors in",
+          DEFAULT_SHM_NAME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+}
+
+static void
+gst_adshmsink_init (GstAdshmsink *adshmsink)
+{
+  adshmsink->shm_name = g_strdup (DEFAULT_SHM_NAME);
+  adshmsink->shm = NULL;
+
+  // descriptors are published as soon as they arrive, ahead of the audio
+  // they apply to, rather than at their timestamps,
+  gst_base_sink_set_sync (GST_BASE_SINK (adshmsink), FALSE);
+}
+
+void
+gst_adshmsink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAdshmsink *adshmsink = GST_ADSHMSINK (object);
+
+  GST_DEBUG_OBJECT (adshmsink, "set_property");
+
+  switch (property_id) {
+    case PROP_SHM_NAME:
+      GST_OBJECT_LOCK (adshmsink);
+      g_free (adshmsink->shm_name);
+      adshmsink->shm_name = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (adshmsink);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_adshmsink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAdshmsink *adshmsink = GST_ADSHMSINK (object);
+
+  GST_DEBUG_OBJECT (adshmsink, "get_property");
+
+  switch (property_id) {
+    case PROP_SHM_NAME:
+      GST_OBJECT_LOCK (adshmsink);
+      g_value_set_string (value, adshmsink->shm_name);
+      GST_OBJECT_UNLOCK (adshmsink);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_adshmsink_finalize (GObject * object)
+{
+  GstAdshmsink *adshmsink = GST_ADSHMSINK (object);
+
+  GST_DEBUG_OBJECT (adshmsink, "finalize");
+
+  /* clean up object here */
+  g_free (adshmsink->shm_name);
+
+  G_OBJECT_CLASS (gst_adshmsink_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_adshmsink_start (GstBaseSink * sink)
+{
+  GstAdshmsink *adshmsink = GST_ADSHMSINK (sink);
+  GError *error = NULL;
+
+  GST_OBJECT_LOCK (adshmsink);
+  gchar *name = g_strdup (adshmsink->shm_name);
+  GST_OBJECT_UNLOCK (adshmsink);
+
+  adshmsink->shm = name ? gst_ad_shm_create (name, &error) : NULL;
+  if (adshmsink->shm == NULL) {
+    GST_ELEMENT_ERROR (adshmsink, RESOURCE, OPEN_WRITE,
+        ("Could not create shared memory \"%s\"", GST_STR_NULL (name)),
+        ("%s", error ? error->message : "no shm-name given"));
+    g_clear_error (&error);
+    g_free (name);
+    return FALSE;
+  }
+  GST_INFO_OBJECT (adshmsink, "publishing descriptors in %s", name);
+  g_free (name);
+  return TRUE;
+}
+
+static gboolean
+gst_adshmsink_stop (GstBaseSink * sink)
+{
+  GstAdshmsink *adshmsink = GST_ADSHMSINK (sink);
+
+  // the segment itself is left in place for readers, and for this or
+  // another publisher to carry on with,
+  if (adshmsink->shm) {
+    gst_ad_shm_close (adshmsink->shm);
+    adshmsink->shm = NULL;
+  }
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_adshmsink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstAdshmsink *adshmsink = GST_ADSHMSINK (sink);
+
+  GstClockTime ts = gst_segment_to_running_time (&sink->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (ts)) {
+    GST_DEBUG_OBJECT (adshmsink, "descriptor outside segment");
+    return GST_FLOW_OK;
+  }
+  ts += gst_element_get_base_time (GST_ELEMENT (sink));
+
+  GstMapInfo map;
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    return GST_FLOW_ERROR;
+  }
+  if (map.size < 9) {
+    GST_WARNING_OBJECT (adshmsink, "dropping descriptor of only %"
+        G_GSIZE_FORMAT " bytes", map.size);
+    gst_buffer_unmap (buffer, &map);
+    return GST_FLOW_OK;
+  }
+  // only the descriptor itself (as given by its length field, so never
+  // more than an entry holds) is published; any trailing bytes, such as
+  // the CRC added by WHP 198, are not,
+  gsize size = 1 + (map.data[0] & 0x0f);
+  if (size > map.size) {
+    GST_WARNING_OBJECT (adshmsink, "descriptor of %" G_GSIZE_FORMAT
+        " bytes cut short at %" G_GSIZE_FORMAT, size, map.size);
+    size = map.size;
+  }
+  gst_ad_shm_write (adshmsink->shm, ts, map.data, size);
+  gst_buffer_unmap (buffer, &map);
+
+  GST_LOG_OBJECT (adshmsink, "published descriptor for %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (ts));
+  return GST_FLOW_OK;
+}
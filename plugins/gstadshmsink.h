@@ -0,0 +1,56 @@
+/* GStreamer
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ADSHMSINK_H_
+#define _GST_ADSHMSINK_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include "gstadshm.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ADSHMSINK   (gst_adshmsink_get_type())
+#define GST_ADSHMSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ADSHMSINK,GstAdshmsink))
+#define GST_ADSHMSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ADSHMSINK,GstAdshmsinkClass))
+#define GST_IS_ADSHMSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ADSHMSINK))
+#define GST_IS_ADSHMSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ADSHMSINK))
+
+typedef struct _GstAdshmsink GstAdshmsink;
+typedef struct _GstAdshmsinkClass GstAdshmsinkClass;
+
+struct _GstAdshmsink
+{
+  GstBaseSink base_adshmsink;
+
+  // name of the shared-memory segment (protected by the object lock),
+  gchar *shm_name;
+  GstAdShm *shm;
+};
+
+struct _GstAdshmsinkClass
+{
+  GstBaseSinkClass base_adshmsink_class;
+};
+
+GType gst_adshmsink_get_type (void);
+
+G_END_DECLS
+
+#endif
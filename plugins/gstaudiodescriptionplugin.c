@@ -48,6 +48,9 @@
 #include <gst/gst.h>
 #include "gstwhp198dec.h"
 #include "gstadcontrol.h"
+#include "gstadpesparse.h"
+#include "gstadpesinject.h"
+#include "gstadshmsink.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
@@ -56,6 +59,12 @@ plugin_init (GstPlugin * plugin)
       GST_TYPE_WHP198DEC);
   gst_element_register (plugin, "adcontrol", GST_RANK_NONE,
       GST_TYPE_ADCONTROL);
+  gst_element_register (plugin, "adpesparse", GST_RANK_NONE,
+      GST_TYPE_ADPESPARSE);
+  gst_element_register (plugin, "adpesinject", GST_RANK_NONE,
+      GST_TYPE_ADPESINJECT);
+  gst_element_register (plugin, "adshmsink", GST_RANK_NONE,
+      GST_TYPE_ADSHMSINK);
 
   return TRUE;
 }
@@ -29,14 +29,25 @@
  * ]|
  * Extract WHP198 waveform from a stereo WAV file and dump the decoded descriptors
  * </refsect2>
+ *
+ * A redundant copy of the WHP 198 signal may be given to the standby_sink
+ * request pad, where it is decoded alongside the signal on the sink pad
+ * but yields no descriptors.  The "promote-standby" signal swaps the roles
+ * of the two inputs, and since the standby decoder is already synchronised
+ * the descriptors continue without a gap.  Alternatively, the "snapshot"
+ * signal saves the decoder's state (including the last valid descriptor)
+ * and "restore" resumes from it, e.g. in a new whp198dec after a change of
+ * channel.  Only the last valid descriptor is sure to survive a restore: the
+ * phase of the Manchester decoding is only carried over if the new audio
+ * follows on sample-exactly from the old; otherwise decoding resynchronises
+ * from the next descriptor.
  */
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#include <stdlib.h>
-#include <math.h>
+#include <string.h>
 #include <gst/gst.h>
 #include "gstwhp198dec.h"
 
@@ -53,27 +64,46 @@ static void gst_whp198dec_get_property (GObject * object,
 static void gst_whp198dec_dispose (GObject * object);
 static void gst_whp198dec_finalize (GObject * object);
 
-static GstFlowReturn gst_whp198dec_handle_frame (GstWhp198dec *dec,
+static GstFlowReturn gst_whp198dec_chain (GstPad * pad, GstObject * parent,
     GstBuffer * buffer);
+static gboolean gst_whp198dec_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_whp198dec_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static GstPad *gst_whp198dec_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_whp198dec_release_pad (GstElement * element, GstPad * pad);
+static GBytes *gst_whp198dec_snapshot (GstWhp198dec * whp198dec);
+static gboolean gst_whp198dec_restore (GstWhp198dec * whp198dec,
+    GBytes * state);
+static gboolean gst_whp198dec_promote_standby (GstWhp198dec * whp198dec);
+static void gst_whp198dec_descriptor (const whp198_descriptor *descriptor,
+    void *user_data);
+static GstStructure *quality_stats (const whp198_quality_summary *summary);
 
 enum
 {
-  PROP_0
+  SIGNAL_SNAPSHOT,
+  SIGNAL_RESTORE,
+  SIGNAL_PROMOTE_STANDBY,
+  LAST_SIGNAL
 };
 
-enum
-{
-  STATE_UNSYNCHRONISED,
-  STATE_FIRST_TRANSITION,
-  STATE_SYNCHRONISED
-};
+static guint gst_whp198dec_signals[LAST_SIGNAL] = { 0 };
 
 enum
 {
-  AD_STATE_AWAIT_TAG,
-  AD_STATE_CONSUME_TAIL
+  PROP_0,
+  PROP_STATS,
+  PROP_QUALITY_INTERVAL,
+  PROP_POST_MESSAGES,
+  PROP_FIRST_BIT_TIMESTAMPS
 };
 
+#define DEFAULT_QUALITY_INTERVAL GST_SECOND
+#define DEFAULT_POST_MESSAGES FALSE
+#define DEFAULT_FIRST_BIT_TIMESTAMPS FALSE
+
 
 /* pad templates */
 
@@ -92,6 +122,14 @@ GST_STATIC_PAD_TEMPLATE ("sink",
         "channels=1,layout=interleaved")
     );
 
+static GstStaticPadTemplate gst_whp198dec_standby_sink_template =
+GST_STATIC_PAD_TEMPLATE ("standby_sink",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("audio/x-raw,format=S16LE,rate=48000,"
+        "channels=1,layout=interleaved")
+    );
+
 
 /* class initialization */
 
@@ -110,6 +148,8 @@ gst_whp198dec_class_init (GstWhp198decClass * klass)
       gst_static_pad_template_get (&gst_whp198dec_src_template));
   gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
       gst_static_pad_template_get (&gst_whp198dec_sink_template));
+  gst_element_class_add_pad_template (GST_ELEMENT_CLASS (klass),
+      gst_static_pad_template_get (&gst_whp198dec_standby_sink_template));
 
   gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
       "WHP198 Audio Description data track decoder",
@@ -121,33 +161,140 @@ gst_whp198dec_class_init (GstWhp198decClass * klass)
   gobject_class->get_property = gst_whp198dec_get_property;
   gobject_class->dispose = gst_whp198dec_dispose;
   gobject_class->finalize = gst_whp198dec_finalize;
+  GST_ELEMENT_CLASS (klass)->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_whp198dec_request_new_pad);
+  GST_ELEMENT_CLASS (klass)->release_pad =
+      GST_DEBUG_FUNCPTR (gst_whp198dec_release_pad);
+  klass->snapshot = gst_whp198dec_snapshot;
+  klass->restore = gst_whp198dec_restore;
+  klass->promote_standby = gst_whp198dec_promote_standby;
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Signal quality measured over the last complete quality-interval",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_QUALITY_INTERVAL,
+      g_param_spec_uint64 ("quality-interval", "Quality interval",
+          "Interval over which signal quality is measured (in nanoseconds)",
+          GST_MSECOND, G_MAXUINT64, DEFAULT_QUALITY_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_POST_MESSAGES,
+      g_param_spec_boolean ("post-messages", "Post messages",
+          "Post a 'whp198dec-quality' element message at the end of each quality-interval",
+          DEFAULT_POST_MESSAGES, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FIRST_BIT_TIMESTAMPS,
+      g_param_spec_boolean ("first-bit-timestamps", "First bit timestamps",
+          "Timestamp each descriptor with the time of its first bit, rather than its last",
+          DEFAULT_FIRST_BIT_TIMESTAMPS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstWhp198dec::snapshot:
+   * @whp198dec: the whp198dec
+   *
+   * Save the state of the active input's decoder, including the last
+   * valid descriptor, for the "restore" signal of this or another
+   * whp198dec.  The state is only meaningful to a whp198dec using the
+   * same build of libwhp198, and starts with a header giving the version
+   * and size of the state, so that "restore" can refuse any other.
+   *
+   * Returns: (transfer full): the decoder state
+   */
+  gst_whp198dec_signals[SIGNAL_SNAPSHOT] =
+      g_signal_new ("snapshot", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstWhp198decClass, snapshot), NULL, NULL, NULL,
+      G_TYPE_BYTES, 0);
+  /**
+   * GstWhp198dec::restore:
+   * @whp198dec: the whp198dec
+   * @state: a decoder state from the "snapshot" signal
+   *
+   * Continue decoding the active input from @state, as if its next buffer
+   * directly followed the audio decoded when @state was saved (so that a
+   * DISCONT flag on that buffer is ignored).  The last valid descriptor
+   * of @state is repeated at the start of that buffer, so the fade in
+   * force when @state was saved applies at once.  Nothing realigns the
+   * Manchester bit phase, so unless that buffer is sample-aligned with
+   * the audio decoded when @state was saved, any descriptor part-way
+   * through being received is lost and decoding resynchronises from the
+   * next one.
+   *
+   * Returns: %TRUE if @state was restored, or %FALSE if it was not saved
+   * by a compatible whp198dec
+   */
+  gst_whp198dec_signals[SIGNAL_RESTORE] =
+      g_signal_new ("restore", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstWhp198decClass, restore), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 1, G_TYPE_BYTES);
+  /**
+   * GstWhp198dec::promote-standby:
+   * @whp198dec: the whp198dec
+   *
+   * Make the input on standby_sink the active input, and the previously
+   * active input the standby.  A standby input which is flushing or has
+   * reached the end of its stream is not promoted.
+   *
+   * Returns: %TRUE if there was a live standby input to promote
+   */
+  gst_whp198dec_signals[SIGNAL_PROMOTE_STANDBY] =
+      g_signal_new ("promote-standby", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstWhp198decClass, promote_standby), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 0);
 }
 
-static GstFlowReturn
-gst_whp198dec_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+static void
+gst_whp198dec_input_init (GstWhp198dec * whp198dec, GstWhp198decInput *input,
+    GstPad *pad)
 {
-  GstWhp198dec *whp198dec = GST_WHP198DEC (parent);
-  return gst_whp198dec_handle_frame (whp198dec, buffer);
+  input->dec = whp198dec;
+  input->pad = pad;
+  // (a standby_sink requested again has a decoder from before,)
+  if (input->decoder) {
+    whp198_decoder_free (input->decoder);
+  }
+  input->decoder = whp198_decoder_new (gst_whp198dec_descriptor, input);
+  input->buffer_ts = GST_CLOCK_TIME_NONE;
+  input->buffer_start_sample = 0;
+  g_queue_init (&input->pending);
+  input->restored = FALSE;
+  input->eos = FALSE;
+  input->flushing = FALSE;
+
+  gst_pad_set_element_private (pad, input);
+  gst_pad_set_chain_function (pad, GST_DEBUG_FUNCPTR (gst_whp198dec_chain));
+  gst_pad_set_event_function (pad,
+      GST_DEBUG_FUNCPTR (gst_whp198dec_sink_event));
+  gst_pad_use_fixed_caps (pad);
 }
 
 static void
 gst_whp198dec_init (GstWhp198dec * whp198dec)
 {
-  whp198dec->manchester.last_sample = 0;
-  whp198dec->manchester.state = STATE_UNSYNCHRONISED;
-  whp198dec->descriptor.accumulator = 0;
-  whp198dec->descriptor.state = AD_STATE_AWAIT_TAG;
-  whp198dec->descriptor.buffer = NULL;
-  whp198dec->descriptor.buffer_write_offset = 0;
+  whp198dec->last_length = 8;
+  whp198dec->latency_changed = FALSE;
+  whp198dec->quality_interval = DEFAULT_QUALITY_INTERVAL;
+  whp198dec->post_messages = DEFAULT_POST_MESSAGES;
+  whp198dec->first_bit_timestamps = DEFAULT_FIRST_BIT_TIMESTAMPS;
 
   whp198dec->srcpad =
       gst_pad_new_from_static_template (&gst_whp198dec_src_template, "src");
   whp198dec->sinkpad =
       gst_pad_new_from_static_template (&gst_whp198dec_sink_template, "sink");
 
-  gst_pad_set_chain_function (whp198dec->sinkpad,
-      GST_DEBUG_FUNCPTR (gst_whp198dec_chain));
-  gst_pad_use_fixed_caps (whp198dec->sinkpad);
+  gst_whp198dec_input_init (whp198dec, &whp198dec->main, whp198dec->sinkpad);
+  whp198dec->standby.pad = NULL;
+  whp198dec->active = &whp198dec->main;
+  g_mutex_init (&whp198dec->lock);
+  g_mutex_init (&whp198dec->push_lock);
+  whp198dec->need_segment = FALSE;
+  whp198_quality_summary summary;
+  whp198_decoder_get_quality (whp198dec->main.decoder, &summary);
+  whp198dec->stats = quality_stats (&summary);
+
+  gst_pad_set_query_function (whp198dec->srcpad,
+      GST_DEBUG_FUNCPTR (gst_whp198dec_src_query));
   gst_pad_use_fixed_caps (whp198dec->srcpad);
 
   gst_element_add_pad (GST_ELEMENT (whp198dec), whp198dec->srcpad);
@@ -163,6 +310,29 @@ gst_whp198dec_set_property (GObject * object, guint property_id,
   GST_DEBUG_OBJECT (whp198dec, "set_property");
 
   switch (property_id) {
+    case PROP_QUALITY_INTERVAL:
+      GST_OBJECT_LOCK (whp198dec);
+      whp198dec->quality_interval = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (whp198dec);
+      break;
+    case PROP_POST_MESSAGES:
+      GST_OBJECT_LOCK (whp198dec);
+      whp198dec->post_messages = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (whp198dec);
+      break;
+    case PROP_FIRST_BIT_TIMESTAMPS: {
+      GST_OBJECT_LOCK (whp198dec);
+      const gboolean changed =
+          whp198dec->first_bit_timestamps != g_value_get_boolean (value);
+      whp198dec->first_bit_timestamps = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (whp198dec);
+      // our reported latency depends on it,
+      if (changed) {
+        gst_element_post_message (GST_ELEMENT (whp198dec),
+            gst_message_new_latency (GST_OBJECT (whp198dec)));
+      }
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -178,6 +348,26 @@ gst_whp198dec_get_property (GObject * object, guint property_id,
   GST_DEBUG_OBJECT (whp198dec, "get_property");
 
   switch (property_id) {
+    case PROP_STATS:
+      GST_OBJECT_LOCK (whp198dec);
+      g_value_set_boxed (value, whp198dec->stats);
+      GST_OBJECT_UNLOCK (whp198dec);
+      break;
+    case PROP_QUALITY_INTERVAL:
+      GST_OBJECT_LOCK (whp198dec);
+      g_value_set_uint64 (value, whp198dec->quality_interval);
+      GST_OBJECT_UNLOCK (whp198dec);
+      break;
+    case PROP_POST_MESSAGES:
+      GST_OBJECT_LOCK (whp198dec);
+      g_value_set_boolean (value, whp198dec->post_messages);
+      GST_OBJECT_UNLOCK (whp198dec);
+      break;
+    case PROP_FIRST_BIT_TIMESTAMPS:
+      GST_OBJECT_LOCK (whp198dec);
+      g_value_set_boolean (value, whp198dec->first_bit_timestamps);
+      GST_OBJECT_UNLOCK (whp198dec);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -202,271 +392,484 @@ gst_whp198dec_finalize (GObject * object)
   GST_DEBUG_OBJECT (whp198dec, "finalize");
 
   /* clean up object here */
+  gst_structure_free (whp198dec->stats);
+  whp198_decoder_free (whp198dec->main.decoder);
+  if (whp198dec->standby.decoder) {
+    whp198_decoder_free (whp198dec->standby.decoder);
+  }
+  g_mutex_clear (&whp198dec->lock);
+  g_mutex_clear (&whp198dec->push_lock);
 
   G_OBJECT_CLASS (gst_whp198dec_parent_class)->finalize (object);
 }
 
 
-#define AD_TEXT_TAG 0x4454474144
-
-static void
-ad_discontinuity(GstWhp198dec *dec)
+/* The time from a descriptor's timestamp until it is pushed, which it is as
+ * soon as its final bit is decoded.  Timestamped with its last bit, that
+ * is no time at all; with its first, it is the time taken for the whole
+ * descriptor (including the trailing reserved bytes and CRC) to arrive at
+ * DATA_RATE. */
+static GstClockTime
+descriptor_latency (GstWhp198dec *dec)
 {
-  dec->descriptor.state = AD_STATE_AWAIT_TAG;
-  dec->descriptor.accumulator = 0;
-  if (dec->descriptor.buffer) {
-    gst_buffer_unref(dec->descriptor.buffer);
-    dec->descriptor.buffer = NULL;
+  GST_OBJECT_LOCK (dec);
+  const gboolean first_bit = dec->first_bit_timestamps;
+  GST_OBJECT_UNLOCK (dec);
+  if (!first_bit) {
+    return 0;
   }
+  const int reserved_bytes = 7;
+  g_mutex_lock (&dec->lock);
+  int bits = (1 + dec->last_length + reserved_bytes) * 8;
+  g_mutex_unlock (&dec->lock);
+  return (GstClockTime) (bits * GST_SECOND / WHP198_DATA_RATE);
 }
 
+static gboolean
+gst_whp198dec_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  GstWhp198dec *dec = GST_WHP198DEC (parent);
 
-static unsigned short crc_table [0x100] = {
-  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 0x8108,
-  0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef, 0x1231, 0x0210,
-  0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6, 0x9339, 0x8318, 0xb37b,
-  0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de, 0x2462, 0x3443, 0x0420, 0x1401,
-  0x64e6, 0x74c7, 0x44a4, 0x5485, 0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee,
-  0xf5cf, 0xc5ac, 0xd58d, 0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6,
-  0x5695, 0x46b4, 0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d,
-  0xc7bc, 0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
-  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b, 0x5af5,
-  0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12, 0xdbfd, 0xcbdc,
-  0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a, 0x6ca6, 0x7c87, 0x4ce4,
-  0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41, 0xedae, 0xfd8f, 0xcdec, 0xddcd,
-  0xad2a, 0xbd0b, 0x8d68, 0x9d49, 0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13,
-  0x2e32, 0x1e51, 0x0e70, 0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a,
-  0x9f59, 0x8f78, 0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e,
-  0xe16f, 0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e, 0x02b1,
-  0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256, 0xb5ea, 0xa5cb,
-  0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d, 0x34e2, 0x24c3, 0x14a0,
-  0x0481, 0x7466, 0x6447, 0x5424, 0x4405, 0xa7db, 0xb7fa, 0x8799, 0x97b8,
-  0xe75f, 0xf77e, 0xc71d, 0xd73c, 0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657,
-  0x7676, 0x4615, 0x5634, 0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9,
-  0xb98a, 0xa9ab, 0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882,
-  0x28a3, 0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
-  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92, 0xfd2e,
-  0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9, 0x7c26, 0x6c07,
-  0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1, 0xef1f, 0xff3e, 0xcf5d,
-  0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 0x6e17, 0x7e36, 0x4e55, 0x5e74,
-  0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
-};
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY: {
+      gboolean live;
+      GstClockTime min, max;
 
-static guint16 crc_16_ccitt(const guint8 *data, const size_t length)
-{ 
-   gint crc = 0x1d0f;
-   gint temp;
+      if (!gst_pad_peer_query (dec->sinkpad, query)) {
+        return FALSE;
+      }
+      gst_query_parse_latency (query, &live, &min, &max);
+      GstClockTime latency = descriptor_latency (dec);
+      GST_DEBUG_OBJECT (dec, "upstream latency min %" GST_TIME_FORMAT
+          ", adding %" GST_TIME_FORMAT, GST_TIME_ARGS (min),
+          GST_TIME_ARGS (latency));
+      min += latency;
+      if (GST_CLOCK_TIME_IS_VALID (max)) {
+        max += latency;
+      }
+      gst_query_set_latency (query, live, min, max);
+      return TRUE;
+    }
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
 
-   for (size_t count = 0; count < length; ++count) {
-     temp = (*data++ ^ (crc >> 8)) & 0xff;
-     crc = crc_table[temp] ^ (crc << 8);
-   }
+static GstStructure *
+quality_stats (const whp198_quality_summary *summary)
+{
+  GValue histogram = G_VALUE_INIT;
+  g_value_init (&histogram, GST_TYPE_ARRAY);
+  for (int i = 0; i < WHP198_ERROR_BINS; i++) {
+    GValue bin = G_VALUE_INIT;
+    g_value_init (&bin, G_TYPE_UINT64);
+    g_value_set_uint64 (&bin, summary->error_histogram[i]);
+    gst_value_array_append_value (&histogram, &bin);
+    g_value_unset (&bin);
+  }
 
-   return (guint16)crc;
+  GstStructure *stats = gst_structure_new ("whp198dec-quality",
+      "transitions", G_TYPE_UINT64, (guint64) summary->transitions,
+      "jitter-rms", G_TYPE_DOUBLE, summary->jitter_rms,
+      "max-error", G_TYPE_DOUBLE, summary->max_error,
+      "epsilon-margin", G_TYPE_DOUBLE, summary->epsilon_margin,
+      "peak-amplitude", G_TYPE_INT, summary->peak_amplitude,
+      "snr", G_TYPE_DOUBLE, summary->snr,
+      "crc-errors", G_TYPE_UINT64, (guint64) summary->crc_errors,
+      "sync-losses", G_TYPE_UINT64, (guint64) summary->sync_losses,
+      NULL);
+  gst_structure_take_value (stats, "error-histogram", &histogram);
+  return stats;
 }
 
-#define BYTE 8
+/* Called with the decoder lock held, for the active input only.  At the end
+ * of each quality interval, returns the message to post (if any) once the
+ * lock is released. */
+static GstMessage *
+quality_interval_check (GstWhp198dec *dec, GstWhp198decInput *input)
+{
+  const gint64 in_sample_count = whp198_decoder_get_sample_count (input->decoder);
+
+  GST_OBJECT_LOCK (dec);
+  GstClockTime interval = dec->quality_interval;
+  gboolean post_messages = dec->post_messages;
+  GST_OBJECT_UNLOCK (dec);
+
+  whp198_quality_summary summary;
+  whp198_decoder_get_quality (input->decoder, &summary);
+  gint64 elapsed = in_sample_count - summary.start_sample;
+  if (elapsed < (gint64) gst_util_uint64_scale (interval, WHP198_SAMPLE_RATE, GST_SECOND)) {
+    return NULL;
+  }
+
+  GstStructure *stats = quality_stats (&summary);
+  whp198_decoder_reset_quality (input->decoder);
+  GstMessage *message = post_messages
+      ? gst_message_new_element (GST_OBJECT (dec), gst_structure_copy (stats))
+      : NULL;
+  GST_OBJECT_LOCK (dec);
+  GstStructure *old = dec->stats;
+  dec->stats = stats;
+  GST_OBJECT_UNLOCK (dec);
+  gst_structure_free (old);
+  return message;
+}
 
+/* called by the decoder (with the decoder lock held) for each descriptor
+ * passing its CRC check */
 static void
-ad_decoded_bit(GstWhp198dec *dec, const int bit, GstClockTime ts)
+gst_whp198dec_descriptor (const whp198_descriptor *descriptor, void *user_data)
 {
-  dec->descriptor.accumulator <<= 1;
-  dec->descriptor.accumulator |= bit;
-  switch (dec->descriptor.state) {
-    case AD_STATE_AWAIT_TAG:
-      if (((dec->descriptor.accumulator >> 16) & 0x00ffffffffff) == AD_TEXT_TAG) {
-        int descriptor_length = (dec->descriptor.accumulator >> (7*BYTE)) & 0x0f;
-        if (descriptor_length < 8) {
-          GST_DEBUG_OBJECT (dec, "invalid descriptor length %d", descriptor_length);
-          return;
-        }
-        int revision_text_tag = (dec->descriptor.accumulator >> BYTE) & 0xff;
-        int AD_fade  =  dec->descriptor.accumulator  & 0xff;
-        GST_DEBUG_OBJECT (dec, "found descriptor, length=%d, revision=%x, fade=%x", descriptor_length, revision_text_tag, AD_fade);
-        int reserved_bytes = 7;
-        GstBuffer *buf = gst_buffer_new_and_alloc (1 + descriptor_length + reserved_bytes);
-        // Assign a timestamp to the buffer holding the descriptor based on the
-        // timestamp of the just-decoded manchester bit.  Might make more sense
-        // to use the timestamp of what we now believe to be the initial bit of
-        // this descriptor, but it's not clear to me exactly what the intended
-        // time of application is for a given descriptor, so this will probably
-        // do,
-        GST_BUFFER_PTS(buf) = ts;
-        GstMapInfo map;
-        if (!gst_buffer_map (buf, &map, GST_MAP_WRITE)) {
-          ad_discontinuity(dec);
-          return;
-	}
-        dec->descriptor.buffer_write_offset = 0;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (7*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (6*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (5*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (4*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (3*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (2*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator >> (1*BYTE)) & 0xff;
-        map.data[dec->descriptor.buffer_write_offset++] = (dec->descriptor.accumulator            ) & 0xff;
-        gst_buffer_unmap(buf, &map);
-        dec->descriptor.state = AD_STATE_CONSUME_TAIL;
-        int descriptor_bytes_consumed = 6;
-        int descriptor_bytes_remaining = descriptor_length - descriptor_bytes_consumed;
-        dec->descriptor.remaining_tail_bits = (descriptor_bytes_remaining + reserved_bytes - 1) * 8;
-        dec->descriptor.buffer = buf;
-      }
-      break;
-    case AD_STATE_CONSUME_TAIL:
-      dec->descriptor.remaining_tail_bits--;
-      if (dec->descriptor.remaining_tail_bits % 8 == 0) {
-        GstMapInfo map;
-        if (!gst_buffer_map (dec->descriptor.buffer, &map, GST_MAP_WRITE)) {
-          ad_discontinuity(dec);
-          return;
-        }
-        map.data[dec->descriptor.buffer_write_offset++] = dec->descriptor.accumulator & 0xff;
-        gst_buffer_unmap(dec->descriptor.buffer, &map);
-      }
-      if (dec->descriptor.remaining_tail_bits == 0) {
-        dec->descriptor.state = AD_STATE_AWAIT_TAG;
-        GstMapInfo map;
-        if (!gst_buffer_map (dec->descriptor.buffer, &map, GST_MAP_WRITE)) {
-          ad_discontinuity(dec);
-          return;
-        }
-        int crc = crc_16_ccitt(map.data, gst_buffer_get_size(dec->descriptor.buffer));
-        gst_buffer_unmap(dec->descriptor.buffer, &map);
-        if (crc == 0) {
-          GstFlowReturn ret = gst_pad_push (dec->srcpad, dec->descriptor.buffer);
-        } else {
-          GST_DEBUG_OBJECT (dec, "Incorrect descriptor CRC found");
-          gst_buffer_unref(dec->descriptor.buffer);
-        }
-        dec->descriptor.buffer = NULL;
-      }
-      break;
+  GstWhp198decInput *input = user_data;
+  GstWhp198dec *dec = input->dec;
+
+  // a standby input is decoded only to keep its decoder synchronised,
+  if (input != dec->active) {
+    return;
+  }
+
+  int length = descriptor->size - 8;
+  if (length != dec->last_length) {
+    // our reported latency depends on the descriptor length, so the
+    // pipeline is to query it again (once the lock is released, since
+    // the query may come straight back to us),
+    dec->last_length = length;
+    dec->latency_changed = TRUE;
+  }
+  GST_DEBUG_OBJECT (dec, "found descriptor, length=%d, revision=%x, fade=%x",
+      length, descriptor->data[6], descriptor->data[7]);
+
+  GstBuffer *buf = gst_buffer_new_and_alloc (descriptor->size);
+  gst_buffer_fill (buf, 0, descriptor->data, descriptor->size);
+  // By default, assign a timestamp to the buffer holding the descriptor
+  // based on the timestamp of the just-decoded manchester bit.  It's not
+  // clear exactly what the intended time of application is for a given
+  // descriptor, but the time of its first bit is the earliest possible;
+  // applying that needs the main audio to be delayed by the length of a
+  // descriptor (see adcontrol's "delay" property),
+  GST_OBJECT_LOCK (dec);
+  gboolean first_bit = dec->first_bit_timestamps;
+  GST_OBJECT_UNLOCK (dec);
+  if (GST_CLOCK_TIME_IS_VALID (input->buffer_ts)) {
+    gint64 offset = (first_bit ? descriptor->first_bit_sample : descriptor->last_bit_sample)
+        - input->buffer_start_sample;
+    if (offset >= 0) {
+      GST_BUFFER_PTS (buf) = input->buffer_ts
+          + gst_util_uint64_scale (offset, GST_SECOND, WHP198_SAMPLE_RATE);
+    } else {
+      // the first bit may have been in an earlier buffer,
+      GstClockTime before = gst_util_uint64_scale (-offset, GST_SECOND, WHP198_SAMPLE_RATE);
+      GST_BUFFER_PTS (buf) = input->buffer_ts > before ? input->buffer_ts - before : 0;
+    }
   }
+  g_queue_push_tail (&input->pending, buf);
 }
 
-static bool
-epsilon_equals(const float a, const float b, const float epsilon)
+/* Push the descriptors yielded by a buffer of the given input, if it is
+ * still the active input, preceded by its SEGMENT if the active input has
+ * changed since the last push. */
+static GstFlowReturn
+gst_whp198dec_push_pending (GstWhp198dec *dec, GstWhp198decInput *input,
+    GQueue *pending)
 {
-  return fabs(a - b) < epsilon;
-}
+  GstFlowReturn flow = GST_FLOW_OK;
+
+  // the standby input, yielding nothing, needn't wait for the active one
+  // to push,
+  g_mutex_lock (&dec->lock);
+  gboolean active = input == dec->active;
+  g_mutex_unlock (&dec->lock);
+  if (!active) {
+    GstBuffer *buf;
+    while ((buf = g_queue_pop_head (pending))) {
+      gst_buffer_unref (buf);
+    }
+    return GST_FLOW_OK;
+  }
 
-#define SAMPLE_FREQ 48000  // samples-per-second
-#define DATA_RATE   1280.0   // bits-per-second
-#define EPSILON_SAMPLES 5
-#define THRESHOLD 1000
+  g_mutex_lock (&dec->push_lock);
+  // (the inputs may have been swapped meanwhile,)
+  g_mutex_lock (&dec->lock);
+  active = input == dec->active;
+  const gboolean need_segment = active && dec->need_segment;
+  if (need_segment) {
+    dec->need_segment = FALSE;
+  }
+  g_mutex_unlock (&dec->lock);
 
-static gboolean
-sign_change(gint a, gint b)
-{
-  return (a < 0) != (b < 0);
+  if (need_segment) {
+    GstEvent *segment = gst_pad_get_sticky_event (input->pad, GST_EVENT_SEGMENT, 0);
+    if (segment) {
+      gst_pad_push_event (dec->srcpad, segment);
+    }
+  }
+  GstBuffer *buf;
+  while ((buf = g_queue_pop_head (pending))) {
+    if (!active) {
+      gst_buffer_unref (buf);
+      continue;
+    }
+    GstFlowReturn ret = gst_pad_push (dec->srcpad, buf);
+    if (flow == GST_FLOW_OK) {
+      flow = ret;
+    }
+  }
+  g_mutex_unlock (&dec->push_lock);
+
+  // the descriptor output being unlinked must not stop the audio upstream,
+  if (flow == GST_FLOW_NOT_LINKED) {
+    return GST_FLOW_OK;
+  }
+  return flow;
 }
 
-static double
-current_transition_estimate_error(struct _GstWhp198decManchester *manchester)
+static GstFlowReturn
+gst_whp198dec_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
 {
-  return manchester->in_sample_count - manchester->next_expected_transition_sample;
+  GstWhp198dec *dec = GST_WHP198DEC (parent);
+  GstWhp198decInput *input = gst_pad_get_element_private (pad);
+  whp198_decoder *decoder = input->decoder;
+  GstMapInfo map;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  g_mutex_lock (&dec->lock);
+  const gboolean restored = input->restored;
+  input->restored = FALSE;
+  if (GST_BUFFER_IS_DISCONT (buffer) && !restored) {
+    whp198_decoder_discontinuity (decoder);
+  }
+
+  whp198_quality_summary before, after;
+  whp198_decoder_get_quality (decoder, &before);
+
+  input->buffer_ts = GST_BUFFER_PTS (buffer);
+  input->buffer_start_sample = whp198_decoder_get_sample_count (decoder);
+  whp198_descriptor last;
+  if (restored && whp198_decoder_get_last_descriptor (decoder, &last)) {
+    // a warm start resumes with the fade which was in force,
+    last.first_bit_sample = input->buffer_start_sample;
+    last.last_bit_sample = input->buffer_start_sample;
+    gst_whp198dec_descriptor (&last, input);
+  }
+  whp198_decoder_push_samples (decoder,
+                               (const gint16 *)map.data,
+                               map.size / sizeof(gint16),
+                               1);
+  whp198_decoder_get_quality (decoder, &after);
+  const gboolean crc_error = after.crc_errors != before.crc_errors;
+  const gboolean sync_lost = after.sync_losses != before.sync_losses;
+  GstMessage *quality = NULL;
+  if (input == dec->active) {
+    quality = quality_interval_check (dec, input);
+  }
+  GQueue pending = input->pending;
+  g_queue_init (&input->pending);
+  const gboolean latency_changed = dec->latency_changed;
+  dec->latency_changed = FALSE;
+  g_mutex_unlock (&dec->lock);
+
+  // messages are posted without the lock held, since a sync bus handler
+  // may well act on them with our action signals, which take it,
+  if (quality) {
+    gst_element_post_message (GST_ELEMENT (dec), quality);
+  }
+  if (latency_changed) {
+    gst_element_post_message (GST_ELEMENT (dec),
+        gst_message_new_latency (GST_OBJECT (dec)));
+  }
+
+  gst_buffer_unmap (buffer, &map);
+  gst_buffer_unref (buffer);
+
+  if (crc_error) {
+    GST_DEBUG_OBJECT (pad, "Incorrect descriptor CRC found");
+  }
+  if (sync_lost) {
+    GST_DEBUG_OBJECT (pad, "lost sync");
+  }
+
+  return gst_whp198dec_push_pending (dec, input, &pending);
 }
 
-enum TransitionType
+static gboolean
+gst_whp198dec_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
 {
-  TRANSITION_BIT,
-  TRANSITION_IGNORE,
-  TRANSITION_SYNC_LOST
-};
+  GstWhp198dec *dec = GST_WHP198DEC (parent);
+  GstWhp198decInput *input = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&dec->lock);
+  // the state of each input's stream is followed, so that a standby input
+  // which has ended or is flushing is not promoted,
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      input->flushing = TRUE;
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      whp198_decoder_discontinuity (input->decoder);
+      input->flushing = FALSE;
+      input->eos = FALSE;
+      break;
+    case GST_EVENT_STREAM_START:
+      input->eos = FALSE;
+      break;
+    case GST_EVENT_EOS:
+      input->eos = TRUE;
+      break;
+    default:
+      break;
+  }
+  const gboolean active = input == dec->active;
+  g_mutex_unlock (&dec->lock);
+
+  // the events of a standby input go no further (its SEGMENT, being
+  // sticky, is kept on its pad to be sent should it be promoted),
+  if (!active) {
+    gst_event_unref (event);
+    return TRUE;
+  }
 
-static enum TransitionType
-mark_transition(struct _GstWhp198decManchester *manchester)
-{
-  enum TransitionType detect = TRANSITION_IGNORE;
-
-  if (manchester->state == STATE_UNSYNCHRONISED) {
-    manchester->state = STATE_FIRST_TRANSITION;
-    manchester->duration_estimate = SAMPLE_FREQ/DATA_RATE;
-    manchester->next_expected_transition_sample = manchester->in_sample_count + manchester->duration_estimate;
-  } else if (manchester->state == STATE_FIRST_TRANSITION) {
-    double error = current_transition_estimate_error(manchester);
-    if (epsilon_equals(error, -manchester->duration_estimate / 2, EPSILON_SAMPLES)) {
-      // this is a transition inbetween bit-centres, rather than a
-      // bit-center transition itself.  Ignore it and wait for the bit
-      // centre to turn up in about duration_estimate/2 samples
-    } else if (epsilon_equals(error, manchester->duration_estimate / 2, EPSILON_SAMPLES)) {
-      // we are out of phase (initial transition must have been a half
-      // bit),
-      manchester->next_expected_transition_sample -= manchester->duration_estimate / 2;
-    } else if (epsilon_equals(error, 0, EPSILON_SAMPLES)) {
-      // found transition at the expected bit-centre, so we are
-      // hopefully in sync,
-      manchester->state = STATE_SYNCHRONISED;
-      manchester->next_expected_transition_sample += manchester->duration_estimate;
-      //GST_DEBUG_OBJECT (dec, "sync found at in_sample_count=%ld", manchester->in_sample_count);
-    } else {
-      manchester->state = STATE_UNSYNCHRONISED;
-      //GST_DEBUG_OBJECT (dec, "failed to acquire sync (error=%f, in_sample_count=%ld, next_expected_transition_sample=%f, duration_estimate=%f)",
-      //                  error, dec->manchester.in_sample_count, dec->manchester.next_expected_transition_sample, dec->manchester.duration_estimate);
-    }
-  } else if (manchester->state == STATE_SYNCHRONISED) {
-    double error = current_transition_estimate_error(manchester);
-    if (epsilon_equals(error, -manchester->duration_estimate / 2, EPSILON_SAMPLES)) {
-      // this is a transition inbetween bit-centres, rather than
-      // a bit-center transition itself
-    } else if (epsilon_equals(error, 0.0, EPSILON_SAMPLES)) {
-      detect = TRANSITION_BIT;
-      manchester->next_expected_transition_sample += manchester->duration_estimate;
-    } else {
-      manchester->state = STATE_UNSYNCHRONISED;
-      detect = TRANSITION_SYNC_LOST;
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS: {
+      // replace the audio caps with our own,
+      gst_event_unref (event);
+      GstCaps *caps = gst_static_pad_template_get_caps (&gst_whp198dec_src_template);
+      gboolean res = gst_pad_push_event (dec->srcpad, gst_event_new_caps (caps));
+      gst_caps_unref (caps);
+      return res;
     }
+    default:
+      break;
+  }
+  if (!GST_EVENT_IS_SERIALIZED (event)) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+  g_mutex_lock (&dec->push_lock);
+  gboolean res = gst_pad_event_default (pad, parent, event);
+  g_mutex_unlock (&dec->push_lock);
+  return res;
+}
+
+static GstPad *
+gst_whp198dec_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstWhp198dec *dec = GST_WHP198DEC (element);
+
+  g_mutex_lock (&dec->lock);
+  if (dec->standby.pad) {
+    g_mutex_unlock (&dec->lock);
+    GST_WARNING_OBJECT (dec, "standby_sink already exists");
+    return NULL;
   }
+  GstPad *pad = gst_pad_new_from_template (templ, "standby_sink");
+  gst_whp198dec_input_init (dec, &dec->standby, pad);
+  g_mutex_unlock (&dec->lock);
 
-  return detect;
+  gst_pad_set_active (pad, TRUE);
+  gst_element_add_pad (element, pad);
+  return pad;
 }
 
 static void
-process_samples (GstWhp198dec *dec, gint16 *data, gint samples, GstClockTime buffer_ts)
+gst_whp198dec_release_pad (GstElement * element, GstPad * pad)
 {
-  struct _GstWhp198decManchester *manchester = &dec->manchester;
-  for (int i=0; i<samples; i++) {
-    gint sample = data[i];
-
-    if (sign_change(sample, manchester->last_sample)) {
-      switch (mark_transition(manchester)) {
-        case TRANSITION_BIT: ;
-          int bit = sample < 0 ? 1 : 0;
-          ad_decoded_bit(dec, bit, buffer_ts + i * GST_SECOND / SAMPLE_FREQ);
-          break;
-        case TRANSITION_SYNC_LOST:
-          GST_DEBUG_OBJECT (dec, "lost sync");
-          ad_discontinuity(dec);
-          break;
-        case TRANSITION_IGNORE:
-          // nothing to do
-          break;
-      }
-    }
-    manchester->last_sample = sample;
-    manchester->in_sample_count++;
+  GstWhp198dec *dec = GST_WHP198DEC (element);
+
+  g_mutex_lock (&dec->lock);
+  if (dec->active == &dec->standby) {
+    GST_INFO_OBJECT (dec, "standby_sink released; sink is active again");
+    dec->active = &dec->main;
+    dec->need_segment = TRUE;
   }
+  dec->standby.pad = NULL;
+  g_mutex_unlock (&dec->lock);
+
+  gst_element_remove_pad (element, pad);
 }
 
-static GstFlowReturn
-gst_whp198dec_handle_frame (GstWhp198dec *dec, GstBuffer * buffer)
+/* A snapshot is the decoder state preceded by its version and size, each a
+ * big-endian 32-bit integer. */
+#define SNAPSHOT_HEADER_SIZE 8
+
+static GBytes *
+gst_whp198dec_snapshot (GstWhp198dec * dec)
 {
-  GstMapInfo map;
+  const gsize size = whp198_decoder_state_size ();
+  guint8 *snapshot = g_malloc (SNAPSHOT_HEADER_SIZE + size);
+  GST_WRITE_UINT32_BE (snapshot, WHP198_STATE_VERSION);
+  GST_WRITE_UINT32_BE (snapshot + 4, size);
 
-  if (!buffer) {
-    return GST_FLOW_OK;
+  g_mutex_lock (&dec->lock);
+  whp198_decoder_save_state (dec->active->decoder, snapshot + SNAPSHOT_HEADER_SIZE);
+  g_mutex_unlock (&dec->lock);
+
+  return g_bytes_new_take (snapshot, SNAPSHOT_HEADER_SIZE + size);
+}
+
+static gboolean
+gst_whp198dec_restore (GstWhp198dec * dec, GBytes * bytes)
+{
+  gsize size;
+  const guint8 *data = g_bytes_get_data (bytes, &size);
+
+  if (size < SNAPSHOT_HEADER_SIZE) {
+    GST_WARNING_OBJECT (dec, "not a decoder state (%" G_GSIZE_FORMAT
+        " bytes)", size);
+    return FALSE;
+  }
+  const guint32 version = GST_READ_UINT32_BE (data);
+  const guint32 state_size = GST_READ_UINT32_BE (data + 4);
+  if (version != WHP198_STATE_VERSION) {
+    GST_WARNING_OBJECT (dec, "decoder state is version %u rather than %u",
+        version, WHP198_STATE_VERSION);
+    return FALSE;
+  }
+  if (state_size != whp198_decoder_state_size ()
+      || size != SNAPSHOT_HEADER_SIZE + state_size) {
+    GST_WARNING_OBJECT (dec, "decoder state of %" G_GSIZE_FORMAT
+        " bytes (claiming %u) rather than %" G_GSIZE_FORMAT, size - SNAPSHOT_HEADER_SIZE,
+        state_size, whp198_decoder_state_size ());
+    return FALSE;
   }
 
-  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
-    return GST_FLOW_ERROR;
+  g_mutex_lock (&dec->lock);
+  whp198_decoder_restore_state (dec->active->decoder, data + SNAPSHOT_HEADER_SIZE);
+  dec->active->restored = TRUE;
+  g_mutex_unlock (&dec->lock);
+
+  GST_INFO_OBJECT (dec, "restored decoder state");
+  return TRUE;
+}
+
+static gboolean
+gst_whp198dec_promote_standby (GstWhp198dec * dec)
+{
+  g_mutex_lock (&dec->lock);
+  if (dec->standby.pad == NULL) {
+    g_mutex_unlock (&dec->lock);
+    GST_WARNING_OBJECT (dec, "no standby_sink to promote");
+    return FALSE;
   }
-  process_samples (dec,
-                   (gint16 *)map.data,
-                   map.size / sizeof(guint16),
-                   GST_BUFFER_PTS(buffer));
-  gst_buffer_unmap (buffer, &map);
-  return GST_FLOW_OK;
+  GstWhp198decInput *standby = dec->active == &dec->main ? &dec->standby : &dec->main;
+  if (standby->eos || standby->flushing) {
+    const gboolean eos = standby->eos;
+    g_mutex_unlock (&dec->lock);
+    GST_WARNING_OBJECT (dec, "not promoting the standby input, which is %s",
+        eos ? "at end of stream" : "flushing");
+    return FALSE;
+  }
+  dec->active = standby;
+  dec->need_segment = TRUE;
+  // signal quality is measured from when an input becomes active,
+  whp198_decoder_reset_quality (dec->active->decoder);
+  GstPad *pad = gst_object_ref (dec->active->pad);
+  g_mutex_unlock (&dec->lock);
+
+  GST_INFO_OBJECT (dec, "promoted %s:%s to active input", GST_DEBUG_PAD_NAME (pad));
+  gst_object_unref (pad);
+  return TRUE;
 }
@@ -20,7 +20,8 @@
 #ifndef _GST_WHP198DEC_H_
 #define _GST_WHP198DEC_H_
 
-#include <stdbool.h>
+#include <gst/gst.h>
+#include "whp198.h"
 
 G_BEGIN_DECLS
 
@@ -32,13 +33,31 @@ G_BEGIN_DECLS
 
 typedef struct _GstWhp198dec GstWhp198dec;
 typedef struct _GstWhp198decClass GstWhp198decClass;
+typedef struct _GstWhp198decInput GstWhp198decInput;
 
-struct _GstWhp198decManchester {
-  gint last_sample;
-  int state;
-  double duration_estimate;
-  gint64 in_sample_count;
-  double next_expected_transition_sample;
+// an audio input, decoded by its own decoder,
+struct _GstWhp198decInput
+{
+  GstWhp198dec *dec;
+  GstPad *pad;
+
+  // the decoder proper, from libwhp198,
+  whp198_decoder *decoder;
+
+  // timestamp and decoder sample index of the start of the buffer being
+  // decoded, used to timestamp the descriptors it yields,
+  GstClockTime buffer_ts;
+  gint64 buffer_start_sample;
+  // descriptors yielded by the buffer being decoded, pushed once decoding
+  // is done,
+  GQueue pending;
+  // set when a state is restored, so that the next buffer continues from
+  // it (despite any DISCONT flag), starting with its last descriptor,
+  gboolean restored;
+  // whether the input's stream has ended or is flushing, so that a dead
+  // standby input is not promoted,
+  gboolean eos;
+  gboolean flushing;
 };
 
 struct _GstWhp198dec
@@ -47,22 +66,39 @@ struct _GstWhp198dec
 
   GstPad *sinkpad, *srcpad;
 
-  // state of Manchester Encoding decode process,
-  struct _GstWhp198decManchester manchester;
-
-  // state of AD Descriptor recogniser,
-  struct {
-    guint64 accumulator;
-    int state;
-    int remaining_tail_bits;
-    GstBuffer *buffer;
-    int buffer_write_offset;
-  } descriptor;
+  // the input on sinkpad and the optional hot-standby input on
+  // standby_sink, and which of them yields the descriptors pushed
+  // downstream (the decoders and 'active' are protected by 'lock'),
+  GstWhp198decInput main, standby;
+  GstWhp198decInput *active;
+  GMutex lock;
+  // serialises pushing downstream from the two inputs, and is held while
+  // the active input's SEGMENT is resent after a change of input,
+  GMutex push_lock;
+  gboolean need_segment;
+
+  // length field of the most recent valid descriptor, used when
+  // answering latency queries, and whether it has changed since the
+  // latency was last queried again (both protected by 'lock'),
+  int last_length;
+  gboolean latency_changed;
+
+  GstClockTime quality_interval;
+  gboolean post_messages;
+  gboolean first_bit_timestamps;
+  // measurements from the last complete interval (protected by the
+  // object lock),
+  GstStructure *stats;
 };
 
 struct _GstWhp198decClass
 {
   GstElementClass base_whp198dec_class;
+
+  // action signals,
+  GBytes *(*snapshot) (GstWhp198dec *whp198dec);
+  gboolean (*restore) (GstWhp198dec *whp198dec, GBytes *state);
+  gboolean (*promote_standby) (GstWhp198dec *whp198dec);
 };
 
 GType gst_whp198dec_get_type (void);
@@ -0,0 +1,89 @@
+/* libwhp198
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Times the decoder over a long signal carrying a descriptor every
+ * 125ms, e.g.
+ *
+ *   make bench-whp198 && ./bench-whp198 3600
+ *
+ * for an hour of signal (ten minutes by default). */
+
+// for clock_gettime() under -std=c99,
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "encode.h"
+#include "whp198.h"
+
+#define PREAMBLE_BITS 32
+#define AMPLITUDE 8000
+
+static void
+count_descriptor (const whp198_descriptor *descriptor, void *user_data)
+{
+  (void) descriptor;
+  (*(unsigned long *) user_data)++;
+}
+
+int
+main (int argc, char **argv)
+{
+  const double seconds = argc > 1 ? atof (argv[1]) : 600.0;
+  const size_t n = (size_t) (seconds * WHP198_SAMPLE_RATE);
+  if (n == 0) {
+    fprintf (stderr, "usage: %s [seconds]\n", argv[0]);
+    return 1;
+  }
+
+  uint8_t descriptor[ENCODE_DESCRIPTOR_SIZE];
+  encode_descriptor (0x40, descriptor);
+  const size_t period = encode_samples (PREAMBLE_BITS
+      + 8 * ENCODE_DESCRIPTOR_SIZE);
+  int16_t *one = malloc (period * sizeof (int16_t));
+  encode_waveform (descriptor, ENCODE_DESCRIPTOR_SIZE, PREAMBLE_BITS,
+      AMPLITUDE, one);
+  int16_t *samples = malloc (n * sizeof (int16_t));
+  if (!one || !samples) {
+    fprintf (stderr, "out of memory\n");
+    return 1;
+  }
+  for (size_t i = 0; i < n; i++) {
+    samples[i] = one[i % period];
+  }
+
+  unsigned long count = 0;
+  whp198_decoder *dec = whp198_decoder_new (count_descriptor, &count);
+  struct timespec start, end;
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  whp198_decoder_push_samples (dec, samples, n, 1);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  whp198_decoder_free (dec);
+
+  const double elapsed = (end.tv_sec - start.tv_sec)
+      + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf ("%zu samples (%.0f s of signal) in %.3f s: %.1f Msamples/s, "
+      "%.0fx real time, %lu descriptors\n", n, seconds, elapsed,
+      n / elapsed / 1e6, seconds / elapsed, count);
+
+  free (samples);
+  free (one);
+  return 0;
+}
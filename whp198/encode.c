@@ -0,0 +1,74 @@
+/* libwhp198
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "encode.h"
+#include "whp198.h"
+
+void
+encode_descriptor (uint8_t fade, uint8_t data[ENCODE_DESCRIPTOR_SIZE])
+{
+  static const uint8_t header[] = {
+    0x48,  // reserved bits and a descriptor_length of 8
+    'D', 'T', 'G', 'A', 'D',
+    '1',   // revision_text_tag
+  };
+  memcpy (data, header, sizeof (header));
+  data[7] = fade;
+  data[8] = 0x00;  // pan
+  memset (data + 9, 0xff, 5);
+  uint16_t crc = whp198_crc_16_ccitt (data, ENCODE_DESCRIPTOR_SIZE - 2);
+  data[ENCODE_DESCRIPTOR_SIZE - 2] = crc >> 8;
+  data[ENCODE_DESCRIPTOR_SIZE - 1] = crc & 0xff;
+}
+
+size_t
+encode_samples (size_t bits)
+{
+  return (size_t) ceil (bits * WHP198_SAMPLE_RATE / WHP198_DATA_RATE);
+}
+
+static int
+bit_at (const uint8_t *data, size_t preamble, size_t index)
+{
+  if (index < preamble) {
+    return (index & 1) == 0;
+  }
+  index -= preamble;
+  return (data[index / 8] >> (7 - index % 8)) & 1;
+}
+
+size_t
+encode_waveform (const uint8_t *data, size_t size, size_t preamble,
+    int16_t amplitude, int16_t *samples)
+{
+  const size_t bits = preamble + 8 * size;
+  const size_t n = encode_samples (bits);
+  for (size_t i = 0; i < n; i++) {
+    const double position = i * WHP198_DATA_RATE / WHP198_SAMPLE_RATE;
+    const size_t index = (size_t) position;
+    const int second_half = position - index >= 0.5;
+    // a one falls from positive to negative at the bit centre, and a zero
+    // rises,
+    const int bit = index < bits ? bit_at (data, preamble, index) : 0;
+    samples[i] = (bit != second_half) ? amplitude : -amplitude;
+  }
+  return n;
+}
@@ -0,0 +1,48 @@
+/* libwhp198
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _WHP198_ENCODE_H_
+#define _WHP198_ENCODE_H_
+
+/* A WHP 198 encoder, just good enough to give test-whp198 and bench-whp198
+ * a known waveform to decode. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// size of the descriptors written by encode_descriptor(),
+#define ENCODE_DESCRIPTOR_SIZE (1 + 8 + 7)
+
+/* Write an AD_descriptor with the given fade byte (and no pan), followed
+ * by its reserved bytes and CRC, into 'data'. */
+void encode_descriptor (uint8_t fade, uint8_t data[ENCODE_DESCRIPTOR_SIZE]);
+
+/* The count of samples that encode_waveform() writes for 'bits' bits. */
+size_t encode_samples (size_t bits);
+
+/* Write the Manchester-encoded waveform of 'size' bytes of 'data' (most
+ * significant bit first) into 'samples', which must hold
+ * encode_samples (preamble + 8 * size) of them.  It is preceded by
+ * 'preamble' bits alternating between one and zero, which have no
+ * transitions between bit centres, so that the decoder cannot mistake
+ * their phase.  Returns the count of samples written. */
+size_t encode_waveform (const uint8_t *data, size_t size, size_t preamble,
+    int16_t amplitude, int16_t *samples);
+
+#endif
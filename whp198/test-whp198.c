@@ -0,0 +1,214 @@
+/* libwhp198
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Decodes known WHP 198 waveforms and checks the descriptors yielded. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "encode.h"
+#include "whp198.h"
+
+#define PREAMBLE_BITS 32
+#define AMPLITUDE 8000
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      fprintf (stderr, "%s:%d: %s: check failed: %s\n", \
+          __FILE__, __LINE__, __func__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+struct collected {
+  whp198_descriptor descriptors[4];
+  int count;
+};
+
+static void
+collect (const whp198_descriptor *descriptor, void *user_data)
+{
+  struct collected *c = user_data;
+  if (c->count < 4) {
+    c->descriptors[c->count] = *descriptor;
+  }
+  c->count++;
+}
+
+/* The waveform of a descriptor with the given fade byte, returning its
+ * length in samples; free() the result. */
+static int16_t *
+make_signal (uint8_t fade, uint8_t descriptor[ENCODE_DESCRIPTOR_SIZE],
+    size_t *n)
+{
+  encode_descriptor (fade, descriptor);
+  int16_t *samples = malloc (encode_samples (PREAMBLE_BITS
+          + 8 * ENCODE_DESCRIPTOR_SIZE) * sizeof (int16_t));
+  *n = encode_waveform (descriptor, ENCODE_DESCRIPTOR_SIZE, PREAMBLE_BITS,
+      AMPLITUDE, samples);
+  return samples;
+}
+
+static void
+check_descriptor (const whp198_descriptor *got, const uint8_t *expected)
+{
+  CHECK (got->size == ENCODE_DESCRIPTOR_SIZE);
+  CHECK (memcmp (got->data, expected, ENCODE_DESCRIPTOR_SIZE) == 0);
+  CHECK (whp198_crc_16_ccitt (got->data, got->size) == 0);
+  uint16_t crc = whp198_crc_16_ccitt (got->data, got->size - 2);
+  CHECK (got->data[got->size - 2] == crc >> 8);
+  CHECK (got->data[got->size - 1] == (crc & 0xff));
+}
+
+static void
+test_single_descriptor (void)
+{
+  uint8_t descriptor[ENCODE_DESCRIPTOR_SIZE];
+  size_t n;
+  int16_t *samples = make_signal (0x40, descriptor, &n);
+
+  struct collected c = { .count = 0 };
+  whp198_decoder *dec = whp198_decoder_new (collect, &c);
+  whp198_decoder_push_samples (dec, samples, n, 1);
+
+  CHECK (c.count == 1);
+  if (c.count == 1) {
+    check_descriptor (&c.descriptors[0], descriptor);
+    // the first bit of the descriptor follows the preamble,
+    const double first = PREAMBLE_BITS * WHP198_SAMPLE_RATE / WHP198_DATA_RATE;
+    CHECK (c.descriptors[0].first_bit_sample > first - 2);
+    CHECK (c.descriptors[0].first_bit_sample < first + 40);
+    CHECK (c.descriptors[0].last_bit_sample < (int64_t) n);
+  }
+  whp198_quality_summary quality;
+  whp198_decoder_get_quality (dec, &quality);
+  CHECK (quality.crc_errors == 0);
+  CHECK (quality.transitions > 8 * ENCODE_DESCRIPTOR_SIZE);
+  CHECK (quality.peak_amplitude == AMPLITUDE);
+  CHECK (whp198_decoder_get_sample_count (dec) == (int64_t) n);
+
+  whp198_decoder_free (dec);
+  free (samples);
+}
+
+/* One channel of interleaved audio, pushed a few samples at a time. */
+static void
+test_interleaved_in_pieces (void)
+{
+  uint8_t descriptor[ENCODE_DESCRIPTOR_SIZE];
+  size_t n;
+  int16_t *samples = make_signal (0x9c, descriptor, &n);
+  int16_t *stereo = malloc (2 * n * sizeof (int16_t));
+  for (size_t i = 0; i < n; i++) {
+    stereo[2 * i] = (int16_t) ((i * 7919) % 20000 - 10000);
+    stereo[2 * i + 1] = samples[i];
+  }
+
+  whp198_decoder *dec = whp198_decoder_new (NULL, NULL);
+  for (size_t i = 0; i < n; i += 7) {
+    size_t count = n - i < 7 ? n - i : 7;
+    whp198_decoder_push_samples (dec, stereo + 2 * i + 1, count, 2);
+  }
+
+  whp198_descriptor got;
+  const int popped = whp198_decoder_pop_descriptor (dec, &got);
+  CHECK (popped);
+  if (popped) {
+    check_descriptor (&got, descriptor);
+  }
+  CHECK (!whp198_decoder_pop_descriptor (dec, &got));
+
+  whp198_decoder_free (dec);
+  free (stereo);
+  free (samples);
+}
+
+static void
+test_corrupt_descriptor (void)
+{
+  uint8_t descriptor[ENCODE_DESCRIPTOR_SIZE];
+  encode_descriptor (0x40, descriptor);
+  // spoil the fade byte, but not the tag by which descriptors are found,
+  descriptor[7] ^= 0x01;
+  int16_t *samples = malloc (encode_samples (PREAMBLE_BITS
+          + 8 * ENCODE_DESCRIPTOR_SIZE) * sizeof (int16_t));
+  size_t n = encode_waveform (descriptor, ENCODE_DESCRIPTOR_SIZE,
+      PREAMBLE_BITS, AMPLITUDE, samples);
+
+  struct collected c = { .count = 0 };
+  whp198_decoder *dec = whp198_decoder_new (collect, &c);
+  whp198_decoder_push_samples (dec, samples, n, 1);
+
+  CHECK (c.count == 0);
+  whp198_quality_summary quality;
+  whp198_decoder_get_quality (dec, &quality);
+  CHECK (quality.crc_errors == 1);
+
+  whp198_decoder_free (dec);
+  free (samples);
+}
+
+/* A state saved part-way through a descriptor, restored into a decoder
+ * given the rest of the signal. */
+static void
+test_save_restore (void)
+{
+  uint8_t descriptor[ENCODE_DESCRIPTOR_SIZE];
+  size_t n;
+  int16_t *samples = make_signal (0x20, descriptor, &n);
+  const size_t split = n / 2;
+
+  whp198_decoder *first = whp198_decoder_new (NULL, NULL);
+  whp198_decoder_push_samples (first, samples, split, 1);
+  void *state = malloc (whp198_decoder_state_size ());
+  whp198_decoder_save_state (first, state);
+
+  whp198_decoder *second = whp198_decoder_new (NULL, NULL);
+  whp198_decoder_restore_state (second, state);
+  whp198_decoder_push_samples (second, samples + split, n - split, 1);
+
+  whp198_descriptor got;
+  const int popped = whp198_decoder_pop_descriptor (second, &got);
+  CHECK (popped);
+  if (popped) {
+    check_descriptor (&got, descriptor);
+  }
+
+  free (state);
+  whp198_decoder_free (second);
+  whp198_decoder_free (first);
+  free (samples);
+}
+
+int
+main (void)
+{
+  test_single_descriptor ();
+  test_interleaved_in_pieces ();
+  test_corrupt_descriptor ();
+  test_save_restore ();
+
+  if (failures) {
+    fprintf (stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,534 @@
+/* libwhp198
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "whp198.h"
+
+enum
+{
+  STATE_UNSYNCHRONISED,
+  STATE_FIRST_TRANSITION,
+  STATE_SYNCHRONISED
+};
+
+enum
+{
+  AD_STATE_AWAIT_TAG,
+  AD_STATE_CONSUME_TAIL
+};
+
+#define EPSILON_SAMPLES 5
+#define BYTE 8
+#define AD_TEXT_TAG 0x4454474144
+
+// one error histogram bin per sample of accepted error,
+typedef char error_bins_check[WHP198_ERROR_BINS == 2 * EPSILON_SAMPLES + 1 ? 1 : -1];
+
+// state of Manchester Encoding decode process,
+struct whp198_manchester {
+  int last_sample;
+  int state;
+  double duration_estimate;
+  int64_t in_sample_count;
+  double next_expected_transition_sample;
+  // timing error of the most recent bit-centre transition, in samples,
+  double last_error;
+};
+
+// state of AD Descriptor recogniser,
+struct whp198_recogniser {
+  uint64_t accumulator;
+  int state;
+  int remaining_tail_bits;
+  whp198_descriptor current;
+};
+
+// signal quality measurements, accumulated until quality_reset(),
+struct whp198_quality {
+  int64_t start_sample;
+  uint64_t transitions;
+  double error_sum;
+  double error_sum_sq;
+  double max_abs_error;
+  uint64_t error_histogram[WHP198_ERROR_BINS];
+  // index of the sample, a quarter of a bit period after the last
+  // bit-centre transition, at which to measure the amplitude (or 0 if
+  // there is none pending),
+  int64_t amplitude_sample;
+  uint64_t peaks;
+  double peak_sum;
+  double peak_sum_sq;
+  int peak_max;
+  uint64_t crc_errors;
+  uint64_t sync_losses;
+};
+
+// the decoding state, as saved by whp198_decoder_save_state(),
+struct whp198_decoder_state {
+  struct whp198_manchester manchester;
+  struct whp198_recogniser descriptor;
+  whp198_descriptor last;
+  int have_last;
+};
+
+struct whp198_decoder {
+  struct whp198_manchester manchester;
+  struct whp198_recogniser descriptor;
+  struct whp198_quality quality;
+
+  whp198_descriptor_func callback;
+  void *user_data;
+
+  whp198_descriptor queue[WHP198_QUEUE_SIZE];
+  unsigned queue_read;
+  unsigned queue_count;
+
+  // the most recent descriptor to pass its CRC check, if 'have_last',
+  whp198_descriptor last;
+  int have_last;
+};
+
+static void quality_reset (struct whp198_quality *quality, int64_t start_sample);
+
+whp198_decoder *
+whp198_decoder_new (whp198_descriptor_func callback, void *user_data)
+{
+  whp198_decoder *dec = calloc (1, sizeof (*dec));
+  if (!dec) {
+    return NULL;
+  }
+  dec->manchester.state = STATE_UNSYNCHRONISED;
+  dec->descriptor.state = AD_STATE_AWAIT_TAG;
+  quality_reset (&dec->quality, 0);
+  dec->callback = callback;
+  dec->user_data = user_data;
+  return dec;
+}
+
+void
+whp198_decoder_free (whp198_decoder *dec)
+{
+  free (dec);
+}
+
+int64_t
+whp198_decoder_get_sample_count (const whp198_decoder *dec)
+{
+  return dec->manchester.in_sample_count;
+}
+
+void
+whp198_decoder_discontinuity (whp198_decoder *dec)
+{
+  dec->manchester.state = STATE_UNSYNCHRONISED;
+  dec->descriptor.state = AD_STATE_AWAIT_TAG;
+  dec->descriptor.accumulator = 0;
+}
+
+static void
+ad_discontinuity (whp198_decoder *dec)
+{
+  dec->descriptor.state = AD_STATE_AWAIT_TAG;
+  dec->descriptor.accumulator = 0;
+}
+
+
+static const uint16_t crc_table [0x100] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 0x8108,
+  0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef, 0x1231, 0x0210,
+  0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6, 0x9339, 0x8318, 0xb37b,
+  0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de, 0x2462, 0x3443, 0x0420, 0x1401,
+  0x64e6, 0x74c7, 0x44a4, 0x5485, 0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee,
+  0xf5cf, 0xc5ac, 0xd58d, 0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6,
+  0x5695, 0x46b4, 0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d,
+  0xc7bc, 0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b, 0x5af5,
+  0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12, 0xdbfd, 0xcbdc,
+  0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a, 0x6ca6, 0x7c87, 0x4ce4,
+  0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41, 0xedae, 0xfd8f, 0xcdec, 0xddcd,
+  0xad2a, 0xbd0b, 0x8d68, 0x9d49, 0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13,
+  0x2e32, 0x1e51, 0x0e70, 0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a,
+  0x9f59, 0x8f78, 0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e,
+  0xe16f, 0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e, 0x02b1,
+  0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256, 0xb5ea, 0xa5cb,
+  0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d, 0x34e2, 0x24c3, 0x14a0,
+  0x0481, 0x7466, 0x6447, 0x5424, 0x4405, 0xa7db, 0xb7fa, 0x8799, 0x97b8,
+  0xe75f, 0xf77e, 0xc71d, 0xd73c, 0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657,
+  0x7676, 0x4615, 0x5634, 0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9,
+  0xb98a, 0xa9ab, 0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882,
+  0x28a3, 0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92, 0xfd2e,
+  0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9, 0x7c26, 0x6c07,
+  0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1, 0xef1f, 0xff3e, 0xcf5d,
+  0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 0x6e17, 0x7e36, 0x4e55, 0x5e74,
+  0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+uint16_t
+whp198_crc_16_ccitt (const uint8_t *data, size_t length)
+{
+   int crc = 0x1d0f;
+   int temp;
+
+   for (size_t count = 0; count < length; ++count) {
+     temp = (*data++ ^ (crc >> 8)) & 0xff;
+     crc = crc_table[temp] ^ (crc << 8);
+   }
+
+   return (uint16_t)crc;
+}
+
+static void
+emit_descriptor (whp198_decoder *dec, const whp198_descriptor *descriptor)
+{
+  if (dec->callback) {
+    dec->callback (descriptor, dec->user_data);
+    return;
+  }
+  if (dec->queue_count == WHP198_QUEUE_SIZE) {
+    // nobody is reading; drop the oldest,
+    dec->queue_read = (dec->queue_read + 1) % WHP198_QUEUE_SIZE;
+    dec->queue_count--;
+  }
+  unsigned write = (dec->queue_read + dec->queue_count) % WHP198_QUEUE_SIZE;
+  dec->queue[write] = *descriptor;
+  dec->queue_count++;
+}
+
+int
+whp198_decoder_pop_descriptor (whp198_decoder *dec,
+    whp198_descriptor *descriptor)
+{
+  if (dec->queue_count == 0) {
+    return 0;
+  }
+  *descriptor = dec->queue[dec->queue_read];
+  dec->queue_read = (dec->queue_read + 1) % WHP198_QUEUE_SIZE;
+  dec->queue_count--;
+  return 1;
+}
+
+int
+whp198_decoder_get_last_descriptor (const whp198_decoder *dec,
+    whp198_descriptor *descriptor)
+{
+  if (!dec->have_last) {
+    return 0;
+  }
+  *descriptor = dec->last;
+  return 1;
+}
+
+size_t
+whp198_decoder_state_size (void)
+{
+  return sizeof (struct whp198_decoder_state);
+}
+
+/* The caller's buffer need not be suitably aligned for the structure, so
+ * it is copied whole. */
+void
+whp198_decoder_save_state (const whp198_decoder *dec, void *data)
+{
+  struct whp198_decoder_state state;
+  memset (&state, 0, sizeof (state));
+  state.manchester = dec->manchester;
+  state.descriptor = dec->descriptor;
+  state.last = dec->last;
+  state.have_last = dec->have_last;
+  memcpy (data, &state, sizeof (state));
+}
+
+void
+whp198_decoder_restore_state (whp198_decoder *dec, const void *data)
+{
+  struct whp198_decoder_state saved;
+  memcpy (&saved, data, sizeof (saved));
+  const struct whp198_decoder_state *state = &saved;
+  const int64_t in_sample_count = dec->manchester.in_sample_count;
+  const int64_t shift = in_sample_count - state->manchester.in_sample_count;
+
+  dec->manchester = state->manchester;
+  dec->manchester.in_sample_count = in_sample_count;
+  dec->manchester.next_expected_transition_sample += shift;
+  dec->descriptor = state->descriptor;
+  dec->descriptor.current.first_bit_sample += shift;
+  dec->descriptor.current.last_bit_sample += shift;
+  dec->last = state->last;
+  dec->have_last = state->have_last;
+  dec->last.first_bit_sample += shift;
+  dec->last.last_bit_sample += shift;
+}
+
+static void
+ad_decoded_bit (whp198_decoder *dec, const int bit)
+{
+  struct whp198_recogniser *rec = &dec->descriptor;
+  whp198_descriptor *current = &rec->current;
+
+  rec->accumulator <<= 1;
+  rec->accumulator |= bit;
+  switch (rec->state) {
+    case AD_STATE_AWAIT_TAG:
+      if (((rec->accumulator >> 16) & 0x00ffffffffff) == AD_TEXT_TAG) {
+        int descriptor_length = (rec->accumulator >> (7*BYTE)) & 0x0f;
+        if (descriptor_length < 8) {
+          return;
+        }
+        int reserved_bytes = 7;
+        current->size = 1 + descriptor_length + reserved_bytes;
+        // the 64 bits now in the accumulator began 63 and a half bit
+        // periods before the centre of this one,
+        current->first_bit_sample = dec->manchester.in_sample_count
+            - (int64_t) lround (63.5 * dec->manchester.duration_estimate);
+        for (int i = 0; i < 8; i++) {
+          current->data[i] = (rec->accumulator >> ((7 - i)*BYTE)) & 0xff;
+        }
+        rec->state = AD_STATE_CONSUME_TAIL;
+        int descriptor_bytes_consumed = 6;
+        int descriptor_bytes_remaining = descriptor_length - descriptor_bytes_consumed;
+        rec->remaining_tail_bits = (descriptor_bytes_remaining + reserved_bytes - 1) * 8;
+      }
+      break;
+    case AD_STATE_CONSUME_TAIL:
+      rec->remaining_tail_bits--;
+      if (rec->remaining_tail_bits % 8 == 0) {
+        size_t offset = current->size - 1 - rec->remaining_tail_bits / 8;
+        current->data[offset] = rec->accumulator & 0xff;
+      }
+      if (rec->remaining_tail_bits == 0) {
+        rec->state = AD_STATE_AWAIT_TAG;
+        current->last_bit_sample = dec->manchester.in_sample_count;
+        if (whp198_crc_16_ccitt (current->data, current->size) == 0) {
+          dec->last = *current;
+          dec->have_last = 1;
+          emit_descriptor (dec, current);
+        } else {
+          dec->quality.crc_errors++;
+        }
+      }
+      break;
+  }
+}
+
+static bool
+epsilon_equals(const float a, const float b, const float epsilon)
+{
+  return fabs(a - b) < epsilon;
+}
+
+static bool
+sign_change(int a, int b)
+{
+  return (a < 0) != (b < 0);
+}
+
+static double
+current_transition_estimate_error(struct whp198_manchester *manchester)
+{
+  return manchester->in_sample_count - manchester->next_expected_transition_sample;
+}
+
+enum TransitionType
+{
+  TRANSITION_BIT,
+  TRANSITION_IGNORE,
+  TRANSITION_SYNC_LOST
+};
+
+static enum TransitionType
+mark_transition(struct whp198_manchester *manchester)
+{
+  enum TransitionType detect = TRANSITION_IGNORE;
+
+  if (manchester->state == STATE_UNSYNCHRONISED) {
+    manchester->state = STATE_FIRST_TRANSITION;
+    manchester->duration_estimate = WHP198_SAMPLE_RATE/WHP198_DATA_RATE;
+    manchester->next_expected_transition_sample = manchester->in_sample_count + manchester->duration_estimate;
+  } else if (manchester->state == STATE_FIRST_TRANSITION) {
+    double error = current_transition_estimate_error(manchester);
+    if (epsilon_equals(error, -manchester->duration_estimate / 2, EPSILON_SAMPLES)) {
+      // this is a transition inbetween bit-centres, rather than a
+      // bit-center transition itself.  Ignore it and wait for the bit
+      // centre to turn up in about duration_estimate/2 samples
+    } else if (epsilon_equals(error, manchester->duration_estimate / 2, EPSILON_SAMPLES)) {
+      // we are out of phase (initial transition must have been a half
+      // bit),
+      manchester->next_expected_transition_sample -= manchester->duration_estimate / 2;
+    } else if (epsilon_equals(error, 0, EPSILON_SAMPLES)) {
+      // found transition at the expected bit-centre, so we are
+      // hopefully in sync,
+      manchester->state = STATE_SYNCHRONISED;
+      manchester->next_expected_transition_sample += manchester->duration_estimate;
+    } else {
+      manchester->state = STATE_UNSYNCHRONISED;
+    }
+  } else if (manchester->state == STATE_SYNCHRONISED) {
+    double error = current_transition_estimate_error(manchester);
+    if (epsilon_equals(error, -manchester->duration_estimate / 2, EPSILON_SAMPLES)) {
+      // this is a transition inbetween bit-centres, rather than
+      // a bit-center transition itself
+    } else if (epsilon_equals(error, 0.0, EPSILON_SAMPLES)) {
+      detect = TRANSITION_BIT;
+      manchester->last_error = error;
+      manchester->next_expected_transition_sample += manchester->duration_estimate;
+    } else {
+      manchester->state = STATE_UNSYNCHRONISED;
+      detect = TRANSITION_SYNC_LOST;
+    }
+  }
+
+  return detect;
+}
+
+static void
+quality_reset (struct whp198_quality *quality, int64_t start_sample)
+{
+  // an amplitude measurement due remains so,
+  const int64_t amplitude_sample = quality->amplitude_sample;
+  memset (quality, 0, sizeof (*quality));
+  quality->start_sample = start_sample;
+  quality->amplitude_sample = amplitude_sample;
+}
+
+static void
+quality_mark_bit (struct whp198_quality *quality, double error)
+{
+  quality->transitions++;
+  quality->error_sum += error;
+  quality->error_sum_sq += error * error;
+  if (fabs (error) > quality->max_abs_error) {
+    quality->max_abs_error = fabs (error);
+  }
+  int bin = (int) lround (error) + EPSILON_SAMPLES;
+  if (bin < 0) {
+    bin = 0;
+  } else if (bin >= WHP198_ERROR_BINS) {
+    bin = WHP198_ERROR_BINS - 1;
+  }
+  quality->error_histogram[bin]++;
+}
+
+/* The waveform is measured once per bit, a quarter of a bit period after
+ * the bit-centre transition, where it is furthest from any transition
+ * (and so from any ringing or slew) and should always reach the same
+ * magnitude.  The spread of those magnitudes gives an estimate of the
+ * noise. */
+static void
+quality_mark_peak (struct whp198_quality *quality, int magnitude)
+{
+  quality->peaks++;
+  quality->peak_sum += magnitude;
+  quality->peak_sum_sq += (double) magnitude * magnitude;
+  if (magnitude > quality->peak_max) {
+    quality->peak_max = magnitude;
+  }
+}
+
+void
+whp198_decoder_get_quality (const whp198_decoder *dec,
+    whp198_quality_summary *summary)
+{
+  const struct whp198_quality *quality = &dec->quality;
+  // cap the SNR estimate for (practically) noiseless signals,
+  const double max_snr = 120.0;
+
+  summary->start_sample = quality->start_sample;
+  summary->transitions = quality->transitions;
+  memcpy (summary->error_histogram, quality->error_histogram,
+      sizeof (summary->error_histogram));
+  summary->crc_errors = quality->crc_errors;
+  summary->sync_losses = quality->sync_losses;
+
+  // the deviation about the mean error, since a constant offset (from a
+  // slightly wrong duration estimate, say) is not jitter,
+  summary->jitter_rms = 0.0;
+  if (quality->transitions > 0) {
+    double mean = quality->error_sum / quality->transitions;
+    double variance = quality->error_sum_sq / quality->transitions - mean * mean;
+    if (variance > 0.0) {
+      summary->jitter_rms = sqrt (variance);
+    }
+  }
+  summary->max_error = quality->max_abs_error;
+  summary->epsilon_margin = EPSILON_SAMPLES - quality->max_abs_error;
+  summary->peak_amplitude = quality->peak_max;
+  summary->snr = 0.0;
+  if (quality->peaks > 0) {
+    double mean = quality->peak_sum / quality->peaks;
+    double variance = quality->peak_sum_sq / quality->peaks - mean * mean;
+    summary->snr = max_snr;
+    if (variance > 0.0) {
+      double snr = 20.0 * log10 (mean / sqrt (variance));
+      if (snr < max_snr) {
+        summary->snr = snr;
+      }
+    }
+  }
+}
+
+void
+whp198_decoder_reset_quality (whp198_decoder *dec)
+{
+  quality_reset (&dec->quality, dec->manchester.in_sample_count);
+}
+
+void
+whp198_decoder_push_samples (whp198_decoder *dec,
+    const int16_t *samples, size_t n, size_t stride)
+{
+  struct whp198_manchester *manchester = &dec->manchester;
+  struct whp198_quality *quality = &dec->quality;
+  for (size_t i = 0; i < n; i++) {
+    int sample = samples[i * stride];
+    if (manchester->in_sample_count == quality->amplitude_sample) {
+      quality_mark_peak (quality, abs (sample));
+    }
+
+    if (sign_change(sample, manchester->last_sample)) {
+      switch (mark_transition(manchester)) {
+        case TRANSITION_BIT: ;
+          int bit = sample < 0 ? 1 : 0;
+          quality_mark_bit (quality, manchester->last_error);
+          quality->amplitude_sample = manchester->in_sample_count
+              + (int64_t) lround (manchester->duration_estimate / 4);
+          ad_decoded_bit(dec, bit);
+          break;
+        case TRANSITION_SYNC_LOST:
+          quality->amplitude_sample = 0;
+          quality->sync_losses++;
+          ad_discontinuity(dec);
+          break;
+        case TRANSITION_IGNORE:
+          // nothing to do
+          break;
+      }
+    }
+    manchester->last_sample = sample;
+    manchester->in_sample_count++;
+  }
+}
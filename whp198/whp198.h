@@ -0,0 +1,150 @@
+/* libwhp198
+ * David Holroyd <dave@badgers-in-foil.co.uk>, Copyright (C) BBC 2016-2017
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _WHP198_H_
+#define _WHP198_H_
+
+/* A decoder for Audio Description descriptors encoded in an audio waveform
+ * per BBC R&D White Paper 198, with no dependencies beyond the C library.
+ *
+ * A decoder is created by whp198_decoder_new(), and samples are given to
+ * whp198_decoder_push_samples() as they arrive; each descriptor which
+ * passes its CRC check is handed to the callback given to
+ * whp198_decoder_new() or, if there is none, queued for
+ * whp198_decoder_pop_descriptor().  The decoder itself is opaque, so that
+ * its internals may change without breaking applications. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WHP198_SAMPLE_RATE 48000  // samples-per-second
+#define WHP198_DATA_RATE   1280.0 // bits-per-second
+
+// the length byte, up to 15 bytes of descriptor, and 7 bytes of reserved
+// data and CRC,
+#define WHP198_MAX_DESCRIPTOR_SIZE (1 + 15 + 7)
+
+// one-sample-wide bins of bit-centre timing error, spanning the range
+// within which a transition is accepted,
+#define WHP198_ERROR_BINS 11
+
+// descriptors queued when no callback is given,
+#define WHP198_QUEUE_SIZE 8
+
+typedef struct whp198_descriptor {
+  uint8_t data[WHP198_MAX_DESCRIPTOR_SIZE];
+  size_t size;
+  // index (counting every sample pushed) of the samples at which the first
+  // and last bits of the descriptor were decoded,
+  int64_t first_bit_sample;
+  int64_t last_bit_sample;
+} whp198_descriptor;
+
+typedef void (*whp198_descriptor_func) (const whp198_descriptor *descriptor,
+    void *user_data);
+
+typedef struct whp198_decoder whp198_decoder;
+
+// signal quality measured since whp198_decoder_reset_quality(),
+typedef struct whp198_quality_summary {
+  int64_t start_sample;   // index of the sample at which measurement began
+  uint64_t transitions;   // count of bit-centre transitions
+  double jitter_rms;      // RMS deviation of bit-centre timing error, in samples
+  double max_error;       // worst bit-centre timing error, in samples
+  double epsilon_margin;  // headroom before transitions would be rejected
+  // counts of bit-centre timing errors, in one-sample bins from
+  // -(WHP198_ERROR_BINS / 2) samples upward,
+  uint64_t error_histogram[WHP198_ERROR_BINS];
+  int peak_amplitude;     // peak waveform magnitude mid-way through half-bits
+  double snr;             // estimated signal-to-noise ratio, in dB
+  uint64_t crc_errors;
+  uint64_t sync_losses;
+} whp198_quality_summary;
+
+/* Create a decoder, which hands descriptors to 'callback' (if not NULL).
+ * Returns NULL if memory is exhausted. */
+whp198_decoder *whp198_decoder_new (whp198_descriptor_func callback,
+    void *user_data);
+void whp198_decoder_free (whp198_decoder *dec);
+
+/* Forget any partially decoded descriptor and resynchronise, for use when
+ * the input is interrupted. */
+void whp198_decoder_discontinuity (whp198_decoder *dec);
+
+/* Decode 'n' 16-bit samples at WHP198_SAMPLE_RATE, taking every 'stride'th
+ * element of 'samples' (so that one channel of interleaved audio may be
+ * given directly). */
+void whp198_decoder_push_samples (whp198_decoder *dec,
+    const int16_t *samples, size_t n, size_t stride);
+
+/* The count of samples pushed so far. */
+int64_t whp198_decoder_get_sample_count (const whp198_decoder *dec);
+
+/* Take the oldest queued descriptor, returning 0 if there are none. */
+int whp198_decoder_pop_descriptor (whp198_decoder *dec,
+    whp198_descriptor *descriptor);
+
+/* Copy the most recent descriptor to pass its CRC check, returning 0 if
+ * there has been none. */
+int whp198_decoder_get_last_descriptor (const whp198_decoder *dec,
+    whp198_descriptor *descriptor);
+
+/* Summarise the signal quality measured so far, and start measuring
+ * afresh from the next sample pushed. */
+void whp198_decoder_get_quality (const whp198_decoder *dec,
+    whp198_quality_summary *summary);
+void whp198_decoder_reset_quality (whp198_decoder *dec);
+
+/* The decoding state (but not the quality measurements, callback or queue)
+ * saved as a block of whp198_decoder_state_size() bytes, which is only
+ * meaningful to the same build of the library.  WHP198_STATE_VERSION
+ * changes whenever the layout of the state does, so that a state stored
+ * elsewhere can be checked before it is restored. */
+#define WHP198_STATE_VERSION 1
+size_t whp198_decoder_state_size (void);
+
+/* Save the decoding state into 'state', so that it can later be restored
+ * into this or another decoder. */
+void whp198_decoder_save_state (const whp198_decoder *dec, void *state);
+
+/* Continue decoding from a saved state, as if the samples next pushed
+ * directly followed those decoded when the state was saved (e.g. when
+ * switching between redundant copies of the same signal).  Sample indices
+ * in the state are rebased onto this decoder's count of samples pushed, so
+ * the indices of the descriptors it yields continue to increase.
+ *
+ * Rebasing assumes that the next sample pushed is the one which would have
+ * followed; nothing realigns the Manchester bit phase.  If the new feed is
+ * not sample-aligned with the old one, the restored phase is wrong, the
+ * descriptor being received is lost, and the decoder resynchronises from
+ * the following sync word as after a discontinuity.  Only the last valid
+ * descriptor is carried over reliably. */
+void whp198_decoder_restore_state (whp198_decoder *dec, const void *state);
+
+uint16_t whp198_crc_16_ccitt (const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif